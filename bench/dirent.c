@@ -0,0 +1,181 @@
+/* ext2p
+ * Directory entry decoding benchmark
+ *
+ * Walks a directory block of 170 entries over and over, once reading each
+ * field (and each character of the name) through the disk cursor, the way
+ * entries used to be read, and once decoding whole records with a DirCursor.
+ * Prints the time per entry for both
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dir.h"
+#include "disk.h"
+#include "fault.h"
+#include "util.h"
+
+#define BENCH_BLOCK_SIZE 4096
+#define BENCH_ROUNDS 20000
+
+static void _makeBlock(char *block);
+static uint64_t _walkFields(Disk *disk);
+static uint64_t _walkRecords(Disk *disk);
+static double _now(void);
+
+int main(int argc, char **argv) {
+	char path[] = "/tmp/ext2p-bench-XXXXXX";
+	const int FD = mkstemp(path);
+	if( FD < 0 ) {
+		FATAL("couldn't create a scratch image\n");
+	}
+
+	char block[BENCH_BLOCK_SIZE];
+	_makeBlock(block);
+
+	if( !utilWriteAll(FD, block, sizeof(block)) ) {
+		FATAL("couldn't write the scratch image\n");
+	}
+
+	close(FD);
+
+	/* '-c' reads through the block cache instead of mapping the image */
+	const bool CACHED = argc > 1 && strcmp(argv[1], "-c") == 0;
+	Disk *disk = CACHED ? diskOpenCached(path, 64 * 1024) : diskOpen(path);
+	unlink(path);
+
+	if( disk == NULL ) {
+		return EXIT_FAILURE;
+	}
+
+	diskSetBlockSize(disk, BENCH_BLOCK_SIZE);
+
+	double start = _now();
+	uint64_t entries = 0;
+	for( int i = 0; i < BENCH_ROUNDS; ++i ) {
+		entries += _walkFields(disk);
+	}
+
+	const double FIELDS = (_now() - start) / (double)entries;
+
+	start = _now();
+	entries = 0;
+	for( int i = 0; i < BENCH_ROUNDS; ++i ) {
+		entries += _walkRecords(disk);
+	}
+
+	const double RECORDS = (_now() - start) / (double)entries;
+
+	printf(
+		"%" PRIu64 " entries per block, %s\n", entries / BENCH_ROUNDS,
+		CACHED ? "cached" : "mapped"
+	);
+	printf("per field:  %6.1f ns/entry\n", FIELDS);
+	printf("per record: %6.1f ns/entry\n", RECORDS);
+
+	diskClose(disk);
+	return EXIT_SUCCESS;
+}
+
+/* Fills a block with entries named like those of a big mail spool */
+static void _makeBlock(char *block) {
+	memset(block, 0, BENCH_BLOCK_SIZE);
+
+	uint32_t at = 0;
+	for( uint32_t i = 0; at + 24 <= BENCH_BLOCK_SIZE; ++i ) {
+		char name[17];
+		const int LEN = snprintf(name, sizeof(name), "msg%013" PRIu32, i);
+
+		/* The last entry takes up the rest of the block */
+		const uint16_t REC_LEN =
+			(at + 48 > BENCH_BLOCK_SIZE) ? BENCH_BLOCK_SIZE - at : 24;
+
+		char *entry = block + at;
+		const uint32_t INODE = htole32(i + 12);
+		const uint16_t REC = htole16(REC_LEN);
+
+		memcpy(entry, &INODE, 4);
+		memcpy(entry + 4, &REC, 2);
+		entry[6] = (char)LEN;
+		entry[7] = DIR_FT_FILE;
+		memcpy(entry + DIR_ENTRY_HEADER_SIZE, name, LEN);
+
+		at += REC_LEN;
+	}
+}
+
+/* Reads every entry a field at a time, and every name a byte at a time */
+static uint64_t _walkFields(Disk *disk) {
+	uint64_t entries = 0;
+	uint64_t sum = 0;
+
+	uint32_t at = 0;
+	while( at < BENCH_BLOCK_SIZE ) {
+		diskSeek(disk, at);
+
+		const uint32_t INODE = diskRead32(disk);
+		const uint16_t REC_LEN = diskRead16(disk);
+		const uint8_t NAME_LEN = diskRead8(disk);
+		const uint8_t FILETYPE = diskRead8(disk);
+
+		char name[DIR_NAME_MAX + 1];
+		for( uint8_t i = 0; i < NAME_LEN; ++i ) {
+			name[i] = (char)diskRead8(disk);
+		}
+
+		name[NAME_LEN] = '\0';
+
+		sum += INODE + FILETYPE + (uint8_t)name[0];
+		++entries;
+
+		at += REC_LEN;
+	}
+
+	/* Keeps the reads from being optimised away */
+	if( sum == 0 ) {
+		puts("");
+	}
+
+	return entries;
+}
+
+/* Decodes every entry as one record, straight out of the block */
+static uint64_t _walkRecords(Disk *disk) {
+	uint64_t entries = 0;
+	uint64_t sum = 0;
+
+	DiskBlock block = diskGetBlock(disk, 0);
+
+	DirCursor cursor;
+	dirCursorInit(&cursor, block.data, (uint32_t)block.size, 0);
+
+	Dir dir;
+	while( dirCursorNext(&cursor, &dir) ) {
+		sum += dir.inode + dir.filetype + (uint8_t)dir.filename[0];
+		++entries;
+	}
+
+	diskReleaseBlock(disk, &block);
+
+	if( sum == 0 ) {
+		puts("");
+	}
+
+	return entries;
+}
+
+static double _now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
@@ -0,0 +1,86 @@
+#ifndef GUARD_EXT2P_BALLOC_H_
+#define GUARD_EXT2P_BALLOC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bg.h"
+#include "disk.h"
+
+/* Blocks a file's first window spans when the Superblock doesn't say */
+#define BALLOC_DEFAULT_WINDOW 8
+
+/* Largest a window grows to while a file keeps being extended */
+#define BALLOC_MAX_WINDOW 1024
+
+/* Hash buckets windows are looked up in (a power of two) */
+#define BALLOC_BUCKETS 64
+
+/* A run of free blocks set aside for one inode
+ * Windows only live in memory: the blocks stay free on disk until they're
+ * handed out, so dropping a window never leaks anything
+ */
+typedef struct _BAllocWindow {
+	uint32_t inode;
+	uint32_t start; /* First block of the window */
+	uint32_t end; /* Block after the window */
+	uint32_t next; /* Next block to hand out */
+	uint32_t size; /* Blocks the window was asked to span */
+
+	struct _BAllocWindow *chain; /* Next window in the same hash bucket */
+} BAllocWindow;
+
+/* Block allocator working on the group bitmaps
+ *
+ * Each inode being extended gets a window of free blocks next to where its
+ * data already is, and the window doubles each time the file runs through
+ * it. Files written a block at a time still end up in long runs, even when
+ * several of them grow at once. Windows are found by inode through a hash
+ * table, and kept sorted by first block so checking a run against all of them
+ * is a binary search
+ */
+typedef struct _BAlloc {
+	Disk *disk;
+	BlockGroup *bgs;
+	size_t bgCount;
+
+	BAllocWindow **buckets;
+	size_t bucketMask;
+
+	BAllocWindow **sorted; /* Windows with blocks set aside, by first block */
+	size_t count;
+	size_t capacity;
+
+	bool dirty; /* Superblock counts changed since the last 'ballocCommit' */
+} BAlloc;
+
+BAlloc *ballocNew(Disk *disk, BlockGroup *bgs, size_t bgCount);
+void ballocFree(BAlloc *balloc);
+
+/* Allocates a block for 'inode', as close after 'goal' as possible
+ * 'goal' is usually the file's last block, or 0 for the start of the group
+ * holding the inode. Blocks in other inodes' windows are only handed out once
+ * nothing else is free, and the Superblock's reserved blocks never are.
+ * Returns 0 if the filesystem is full
+ */
+uint32_t ballocAlloc(BAlloc *balloc, uint32_t inode, bool isDir, uint32_t goal);
+
+/* Like 'ballocAlloc', but hands out up to '*count' blocks in a row at once,
+ * as many as the window has left, and sets '*count' to how many it did
+ * Returns the first of them, or 0 if the filesystem is full
+ */
+uint32_t ballocAllocRun(
+	BAlloc *balloc, uint32_t inode, bool isDir, uint32_t goal, uint32_t *count
+);
+
+/* Drops the window of 'inode', if it has one */
+void ballocDiscard(BAlloc *balloc, uint32_t inode);
+
+/* Writes the Superblock, if allocations changed its free block count
+ * Groups are written as blocks are handed out, but the Superblock only once
+ * per batch of allocations
+ */
+void ballocCommit(BAlloc *balloc);
+
+#endif // !GUARD_EXT2P_BALLOC_H_
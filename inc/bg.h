@@ -8,37 +8,134 @@
 #include "bgdescriptor.h"
 #include "dir.h"
 #include "disk.h"
+#include "icache.h"
 #include "inode.h"
 #include "superblock.h"
 #include "util.h"
 
+/* Parts of a group that have been read in (see 'BlockGroup.loaded') */
+#define BG_LOADED_BLOCK_BITMAP 0x01
+#define BG_LOADED_INODE_BITMAP 0x02
+
+/* Block groups are opened with only their descriptor read; the bitmaps are
+ * read the first time they're asked for, through 'bgGetBlockBitmap' and
+ * 'bgGetInodeBitmap'. Inodes are read one at a time through the inode cache
+ * shared by all groups
+ */
 typedef struct _BlockGroup {
-	Superblock sb;
+	uint32_t num; /* Position in the descriptor table */
+	Superblock sb; /* Only the first group's copy keeps its free counts */
 	BlockGroupDescriptor desc;
 
+	uint8_t loaded; /* BG_LOADED_* flags */
 	char *blockBitmap;
 	char *inodeBitmap;
-	Inode *inodes;
 
-	Disk *data;
-	uint32_t blocksRead;
+	ICache *icache; /* Shared by all groups */
+
+	Disk *disk; /* The whole image */
 } BlockGroup;
 
-bool bgRead(int num, BlockGroup *bg, Disk *disk);
-bool bgReadAll(BlockGroup *bgs, Disk *disk);
+/* What deletions have given back to a group so far
+ * Freed inodes and blocks are only cleared in the in-memory bitmaps; the
+ * bitmaps and the descriptor's counts go to disk together in 'bgCommitFrees'.
+ * Blocks freed one after another are gathered into a run first, and cleared
+ * all at once when the run ends
+ */
+typedef struct _BGFrees {
+	uint32_t inodes;
+	uint32_t blocks;
+	uint32_t dirs; /* Freed inodes that were directories */
+
+	uint32_t runStart; /* Bitmap index of the first block in the run */
+	uint32_t runLength;
+} BGFrees;
+
+/* How much of the groups' metadata has been read in */
+typedef struct _BGStats {
+	size_t groups;
+	size_t blockBitmaps;
+	size_t inodeBitmaps;
+} BGStats;
+
+/* Reads all 'count' block groups into 'bgs'
+ * The descriptor table is read in one go; nothing else is read until needed
+ */
+bool bgReadAll(BlockGroup *bgs, size_t count, Disk *disk, ICache *icache);
 
 void bgFree(BlockGroup *block);
 void bgFreeAll(BlockGroup *blocks, size_t count);
 
+char *bgGetBlockBitmap(BlockGroup *bg);
+char *bgGetInodeBitmap(BlockGroup *bg);
+
+void bgGetStats(const BlockGroup *bgs, size_t count, BGStats *stats);
+
+/* Returns how many blocks the group has; the last one can be short */
+uint32_t bgGetBlockCount(const BlockGroup *bg);
+
+/* Counts the free blocks and inodes in the group's bitmaps */
+void bgCountFree(BlockGroup *bg, uint32_t *freeBlocks, uint32_t *freeInodes);
+
 void bgGetInode(BlockGroup *bg, uint32_t inodenum, Inode *inode);
+
+/* Replaces inode 'inodenum' with '*inode', in the inode cache and on disk */
+void bgSetInode(BlockGroup *bg, uint32_t inodenum, const Inode *inode);
+
 uint64_t bgGetInodeSize(BlockGroup *bg, Inode *inode);
+uint64_t bgGetDataBlocks(BlockGroup *bg, Inode *inode);
+
+bool bgGetDir(BlockGroup *bg, uint32_t inodenum, DirList *list);
+
+/* Calls 'visit' on each entry of the directory 'inodenum', in on-disk order,
+ * until it returns false
+ * Returns false if 'inodenum' isn't a directory
+ */
+bool bgDirIterate(
+	BlockGroup *bg, uint32_t inodenum, DirVisitor visit, void *ctx
+);
+
+/* Finds the entry called 'NAME' in the directory 'inodenum'
+ * Indexed directories only read the blocks their index leads to; others are
+ * read until the name turns up. On success, 'list' holds the entries of the
+ * block the name was found in and '*entry' points at it
+ */
+bool bgFindEntry(
+	BlockGroup *bg, uint32_t inodenum, const char *NAME, DirList *list,
+	Dir **entry
+);
+
+/* Removes the entry 'dir' from the directory 'parent', whose inode is in
+ * 'parentBg'
+ * Only the entry goes; what it pointed to has to be released separately.
+ * 'isDir' says whether it was a directory, since the entry may not record it
+ */
+void bgUnlink(
+	BlockGroup *parentBg, uint32_t parent, const Dir *dir, bool isDir
+);
+
+/* Drops a link to inode 'inodenum', freeing it once it has none left
+ * Directories are always freed. Returns true if the inode was freed, in which
+ * case '*inode' gets what it held (its blocks still have to be released)
+ */
+bool bgReleaseInode(
+	BlockGroup *bg, uint32_t inodenum, bool isDir, Inode *inode,
+	BGFrees *frees
+);
 
-bool bgGetDir(BlockGroup *bg, uint32_t inodenum, Dir *dir);
-bool bgReadFile(BlockGroup *bg, uint32_t inodenum, FP *fp);
+/* Marks block 'blockno', which has to be in 'bg', as free */
+void bgReleaseBlock(BlockGroup *bg, uint32_t blockno, BGFrees *frees);
 
-void bgDeleteFile(BlockGroup *bg, Dir *root, Dir *dir);
-void bgDeleteDir(BlockGroup *bg, Dir *root, Dir *dir);
+/* Writes out what was freed in 'bg': each changed bitmap once, whole, and the
+ * descriptor with its new counts
+ * 'frees' is emptied afterwards
+ */
+void bgCommitFrees(BlockGroup *bg, BGFrees *frees);
 
-uint32_t bgOffsetBlock(BlockGroup *bg, uint32_t block);
+/* Marks the 'count' blocks from 'blockno' on, which have to be in 'bg', as
+ * used, writing the bitmap bytes they're in and the descriptor straight back
+ * Returns false, taking none of them, if any was already taken
+ */
+bool bgTakeBlocks(BlockGroup *bg, uint32_t blockno, uint32_t count);
 
 #endif // !GUARD_EXT2_BLOCK_H_
@@ -0,0 +1,40 @@
+#ifndef GUARD_EXT2P_BITMAP_H_
+#define GUARD_EXT2P_BITMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Block and inode bitmaps, as stored on disk
+ *
+ * Bit 'n' is bit 'n % 8' of byte 'n / 8', so the bytes read as little-endian
+ * 64-bit words keep the bits in order. Scans go a word at a time, and 16
+ * bytes at a time over full or empty stretches where SSE2 is there, so going
+ * through a whole group's bitmap only takes a few hundred steps. 'nbits' is
+ * how many bits are in use; anything past it is never looked at
+ */
+
+#define BITMAP_NONE SIZE_MAX
+
+bool bitmapTest(const char *bits, size_t bit);
+void bitmapSet(char *bits, size_t bit);
+void bitmapClear(char *bits, size_t bit);
+
+/* Sets or clears the 'count' bits starting at 'start' */
+void bitmapSetRange(char *bits, size_t start, size_t count);
+void bitmapClearRange(char *bits, size_t start, size_t count);
+
+/* Returns how many of the first 'nbits' bits are set */
+size_t bitmapCount(const char *bits, size_t nbits);
+
+/* Returns the first clear bit at or after 'start', or BITMAP_NONE */
+size_t bitmapFindZero(const char *bits, size_t nbits, size_t start);
+
+/* Returns the first of 'len' clear bits in a row at or after 'start', or
+ * BITMAP_NONE if there's no such run
+ */
+size_t bitmapFindZeroRun(
+	const char *bits, size_t nbits, size_t start, size_t len
+);
+
+#endif // !GUARD_EXT2P_BITMAP_H_
@@ -0,0 +1,73 @@
+#ifndef GUARD_EXT2P_BLOCKMAP_H_
+#define GUARD_EXT2P_BLOCKMAP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "disk.h"
+#include "inode.h"
+
+/* Levels of indirection an inode can use (single, double and triple) */
+#define BLOCKMAP_LEVELS 3
+
+/* An indirect block that was read in, with its pointers decoded */
+typedef struct _BlockMapSlot {
+	uint32_t block; /* Physical block held by this slot (0 if empty) */
+	uint32_t *ptrs; /* Decoded pointers ('perBlock' of them) */
+} BlockMapSlot;
+
+/* A run of blocks that are contiguous both in the file and on disk
+ * A run that isn't backed by any blocks (a hole) has a physical block of 0
+ */
+typedef struct _Extent {
+	uint64_t logical; /* First logical block of the run */
+	uint32_t physical; /* First physical block of the run (0 for holes) */
+	uint64_t length; /* Blocks in the run */
+} Extent;
+
+#define EXTENT_IS_HOLE(E) ((E)->physical == 0)
+
+/* Resolves the logical blocks of an inode to physical blocks
+ *
+ * Indirect blocks are read whole and kept, one per level of indirection, so
+ * walking a file sequentially reads each of them only once
+ */
+typedef struct _BlockMap {
+	Disk *disk;
+	const Inode *inode;
+
+	uint32_t blockSize;
+	uint32_t perBlock; /* Block pointers that fit in an indirect block */
+
+	BlockMapSlot slots[BLOCKMAP_LEVELS];
+} BlockMap;
+
+void blockmapInit(
+	BlockMap *map, Disk *disk, uint32_t blockSize, const Inode *inode
+);
+void blockmapFree(BlockMap *map);
+
+/* Returns the physical block holding logical block 'index' of the inode, or
+ * 0 if it isn't mapped
+ */
+uint32_t blockmapGet(BlockMap *map, uint64_t index);
+
+/* Gets the longest run of contiguous blocks starting at logical block 'index'
+ * and ending before logical block 'end'
+ * Holes come back as their own extents, and a missing indirect block skips
+ * everything it would have mapped without reading anything
+ * Returns false if there are no blocks left
+ */
+bool blockmapGetExtent(
+	BlockMap *map, uint64_t index, uint64_t end, Extent *extent
+);
+
+/* Returns how many of the first 'end' logical blocks are backed by data
+ * blocks
+ */
+uint64_t blockmapCountMapped(BlockMap *map, uint64_t end);
+
+/* Returns how many logical blocks a file of 'size' bytes spans */
+uint64_t blockmapBlockCount(BlockMap *map, uint64_t size);
+
+#endif // !GUARD_EXT2P_BLOCKMAP_H_
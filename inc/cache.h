@@ -0,0 +1,85 @@
+#ifndef GUARD_EXT2P_CACHE_H_
+#define GUARD_EXT2P_CACHE_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lru.h"
+
+/* Default size of a cache line, in bytes */
+#define CACHE_LINE_SIZE 4096
+
+/* A single cached block of the image */
+typedef struct _CacheLine {
+	uint64_t index; /* Index of the block (offset / line size) */
+	char *data; /* Contents of the block */
+	bool dirty; /* Modified since it was read; never evicted */
+	bool filling; /* Still being read from the image */
+	unsigned refs; /* Users currently holding the line; never evicted */
+
+	LRUNode lru; /* Only clean lines nobody holds are on the LRU list */
+	struct _CacheLine *chain; /* Next line in the same hash bucket */
+} CacheLine;
+
+/* Counters used to size the cache */
+typedef struct _CacheStats {
+	uint64_t hits; /* Lookups served from memory */
+	uint64_t misses; /* Lookups that had to read from the image */
+	uint64_t evictions; /* Lines dropped to stay within the budget */
+} CacheStats;
+
+/* Bounded LRU cache of fixed-size blocks, read on demand with pread
+ *
+ * Lines are acquired and released under a lock, so the cache can be shared
+ * between threads. The lock isn't held while a line is read in: the line is
+ * marked as filling, and anyone else after it waits for 'filled'. Misses on
+ * different lines don't hold each other up
+ */
+typedef struct _Cache {
+	pthread_mutex_t lock;
+	pthread_cond_t filled; /* Signalled whenever a line is done filling */
+
+	int fd; /* Descriptor of the image */
+	uint64_t fileSize; /* Size of the image */
+
+	size_t lineSize; /* Size of a line */
+	size_t budget; /* Max. bytes of line data kept in memory */
+	size_t used; /* Bytes of line data currently in memory */
+
+	CacheLine **buckets;
+	size_t bucketMask;
+
+	LRUList lru; /* Lines that can be evicted */
+
+	CacheStats stats;
+} Cache;
+
+Cache *cacheNew(int fd, uint64_t fileSize, size_t lineSize, size_t budget);
+void cacheFree(Cache *cache);
+
+/* Returns the line containing block 'index', reading it in if needed
+ * The line stays valid until it is given back with 'cacheRelease'
+ */
+CacheLine *cacheAcquire(Cache *cache, uint64_t index);
+void cacheRelease(Cache *cache, CacheLine *line);
+
+/* Returns the line containing block 'index' if it is cached, NULL otherwise
+ * Doesn't read from the image or touch the LRU order and counters, and must
+ * not race with other users of the cache
+ */
+CacheLine *cachePeek(Cache *cache, uint64_t index);
+
+/* Like 'cacheAcquire', but returns NULL instead of reading the line in */
+CacheLine *cacheAcquireCached(Cache *cache, uint64_t index);
+
+/* Marks a held line as changed, so it's kept until 'cacheMarkClean' */
+void cacheMarkDirty(Cache *cache, CacheLine *line);
+
+/* Forgets that any line was changed, once they've all been saved */
+void cacheMarkClean(Cache *cache);
+
+void cacheGetStats(Cache *cache, CacheStats *stats);
+
+#endif // !GUARD_EXT2P_CACHE_H_
@@ -0,0 +1,70 @@
+#ifndef GUARD_EXT2P_DCACHE_H_
+#define GUARD_EXT2P_DCACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "lru.h"
+
+/* Default memory budget of the dentry cache, in bytes */
+#define DCACHE_DEFAULT_BUDGET (64 * 1024)
+
+/* What a name in a directory resolved to */
+typedef struct _DCacheEntry {
+	uint32_t parent; /* Directory the name is in */
+	uint32_t inode; /* 0 if the directory has no such name */
+	uint8_t filetype;
+	uint8_t nameLen;
+
+	LRUNode lru;
+	struct _DCacheEntry *chain; /* Next entry in the same hash bucket */
+
+	char name[]; /* Null-terminated */
+} DCacheEntry;
+
+/* Bounded LRU cache of directory lookups, keyed by parent inode and name
+ *
+ * Names that turned out not to exist are cached too (as negative entries), so
+ * looking for a missing file twice only scans the directory once. Whoever
+ * changes a directory has to forget the names they touched
+ */
+typedef struct _DCache {
+	size_t budget; /* Max. bytes of entries kept in memory */
+	size_t used; /* Bytes of entries currently in memory */
+
+	DCacheEntry **buckets;
+	size_t bucketMask;
+
+	LRUList lru;
+
+	CacheStats stats;
+} DCache;
+
+DCache *dcacheNew(size_t budget);
+void dcacheFree(DCache *dcache);
+
+/* Looks up 'NAME' in the directory 'parent'
+ * Returns false if the lookup isn't cached. Otherwise '*inode' and '*filetype'
+ * are filled in, with '*inode' being 0 if the name is known not to exist
+ */
+bool dcacheLookup(
+	DCache *dcache, uint32_t parent, const char *NAME, uint32_t *inode,
+	uint8_t *filetype
+);
+
+/* Remembers what 'NAME' in the directory 'parent' resolved to
+ * An 'inode' of 0 remembers that there's no such name
+ */
+void dcacheInsert(
+	DCache *dcache, uint32_t parent, const char *NAME, uint32_t inode,
+	uint8_t filetype
+);
+
+/* Drops every name cached for the directory 'parent', for when it's gone */
+void dcacheForgetDir(DCache *dcache, uint32_t parent);
+
+void dcacheGetStats(DCache *dcache, CacheStats *stats);
+
+#endif // !GUARD_EXT2P_DCACHE_H_
@@ -2,10 +2,17 @@
 #define GUARD_EXT2_DIR_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "disk.h"
 
+/* Size of the fixed part of an on-disk directory entry, before the name */
+#define DIR_ENTRY_HEADER_SIZE 8
+
+/* Longest name an entry can have */
+#define DIR_NAME_MAX 255
+
 typedef enum _Dir_Filetype {
 	DIR_FT_UNKNOWN = 0, /* Unknown */
 	DIR_FT_FILE = 1, /* File */
@@ -18,23 +25,85 @@ typedef enum _Dir_Filetype {
 } Dir_Filetype;
 
 typedef struct _Dir {
-	uint32_t offset;
+	uint32_t block; /* Block holding the entry */
+	uint32_t offset; /* Offset of the entry into 'block' */
 
 	uint32_t inode;
 	uint16_t nextEntry;
 
 	uint8_t nameLen;
 	uint8_t filetype;
-	char *filename;
-
-	struct _Dir *next;
+	char *filename; /* Points into the name pool of the owning list */
 } Dir;
 
-Dir *dirNew(void);
+/* The entries of a directory, kept in one array with their names packed into
+ * a single pool, so a whole listing takes a couple of allocations
+ * Entries are in on-disk order
+ */
+typedef struct _DirList {
+	Dir *entries;
+	size_t count;
+	size_t capacity; /* Entries 'entries' has room for */
+
+	char *names; /* Null-terminated names, back to back */
+	size_t namesSize; /* Bytes of 'names' in use */
+	size_t namesCapacity;
+} DirList;
+
+/* Walks the entries of one directory block in place
+ * Entries are decoded as they're reached, so stopping early costs nothing for
+ * the rest of the block. The name of the current entry lives in the cursor,
+ * and is overwritten by the next one
+ */
+typedef struct _DirCursor {
+	const char *block;
+	uint32_t blockSize;
+	uint32_t blockno;
+	uint32_t at; /* Offset of the next entry to decode */
+
+	char name[DIR_NAME_MAX + 1];
+} DirCursor;
+
+/* Called on each entry of a directory being walked
+ * Returning false stops the walk
+ */
+typedef bool (*DirVisitor)(Dir *dir, void *ctx);
+
+/* Decodes the fixed part of the directory entry at 'data' into 'dir'
+ * Checks once that the whole entry fits in the 'size' bytes available, and
+ * returns false if it doesn't
+ */
+bool dirDecodeEntry(const char *data, size_t size, Dir *dir);
 
-void dirReadLinkedList(Disk *disk, uint32_t blockSize, Dir *dir);
-void dirFreeLinkedList(Dir *dir);
+void dirListInit(DirList *list);
+
+/* Empties a list, keeping its memory around for reuse */
+void dirListClear(DirList *list);
+
+void dirListFree(DirList *list);
+
+/* Appends a copy of 'dir', name included, to 'list' */
+void dirListAppend(DirList *list, const Dir *dir);
+
+void dirCursorInit(
+	DirCursor *cursor, const char *block, uint32_t blockSize, uint32_t blockno
+);
+
+/* Decodes the next used entry of the block into 'dir'
+ * Returns false once the block is done, or when a bad entry cuts it short
+ */
+bool dirCursorNext(DirCursor *cursor, Dir *dir);
+
+/* Decodes the entries in directory block 'blockno' and appends them to 'list'
+ * Unused entries are skipped
+ */
+void dirReadBlock(
+	const char *block, uint32_t blockSize, uint32_t blockno, DirList *list
+);
 
 char *dirGetFiletype(Dir *dir);
 
+/* Name of a DIR_FT_* type, as shown to users */
+char *dirFiletypeName(uint8_t filetype);
+
 #endif // !GUARD_EXT2_DIR_H_
@@ -1,49 +1,144 @@
 #ifndef GUARD_EXT2P_DISK_H_
 #define GUARD_EXT2P_DISK_H_
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include "cache.h"
+#include "fault.h"
 #include "util.h"
 
+/* Granularity at which changes are tracked and saved, in bytes */
+#define DISK_PAGE_SIZE CACHE_LINE_SIZE
+
+/* Reads at least this big bypass the block cache: lines that are already
+ * cached are used, and the gaps between them are read with a single pread each
+ */
+#define DISK_STREAM_SIZE (64 * 1024)
+
+/* Block size assumed until 'diskSetBlockSize' is called */
+#define DISK_DEFAULT_BLOCK_SIZE 1024
+
 typedef struct _Disk {
 	char *filepath;
-	FP fp;
+
+	int fd; /* Descriptor of the image */
+
+	char *map; /* Mapped image, or NULL if reads go through the cache */
+	Cache *cache; /* Block cache, or NULL if the image is mapped */
+
+	size_t blockSize; /* Size of the blocks returned by 'diskGetBlock' */
+	unsigned blockShift; /* log2 of 'blockSize' */
+
+	uint64_t pos; /* Cursor */
+	uint64_t size; /* Size of the image */
+
+	uint8_t *dirty; /* Bitmap of pages written to since the last save */
 } Disk;
 
+/* A read-only view of a single block of a disk
+ * Must be given back with 'diskReleaseBlock' once it's no longer needed
+ */
+typedef struct _DiskBlock {
+	const char *data;
+	size_t size;
+
+	CacheLine *_line; /* Cache line held while the block is in use */
+	char *_copy; /* Copy of the block, if it spans multiple cache lines */
+} DiskBlock;
+
 #define READ8() diskRead8(disk);
 #define READ16() diskRead16(disk);
 #define READ32() diskRead32(disk);
 #define READ64() diskRead64(disk);
 
 Disk *diskOpen(const char *FILEPATH);
-Disk *diskClone(Disk *disk);
+Disk *diskOpenCached(const char *FILEPATH, size_t budget);
 
 void diskClose(Disk *disk);
 
-bool diskCheckBounds(Disk *disk, size_t size);
+bool diskCheckBounds(Disk *disk, uint64_t size);
 
 uint8_t diskRead8(Disk *disk);
 uint16_t diskRead16(Disk *disk);
 uint32_t diskRead32(Disk *disk);
 uint64_t diskRead64(Disk *disk);
 
+/* Positional reads
+ *
+ * These don't touch the cursor, so unlike the rest of the API they can be
+ * used from multiple threads at once
+ */
+void diskReadAt(Disk *disk, uint64_t offset, void *dest, size_t size);
+
+uint8_t diskRead8At(Disk *disk, uint64_t offset);
+uint16_t diskRead16At(Disk *disk, uint64_t offset);
+uint32_t diskRead32At(Disk *disk, uint64_t offset);
+uint64_t diskRead64At(Disk *disk, uint64_t offset);
+
+/* Hints that 'size' bytes at 'offset' will be read soon
+ * This never blocks, and out of range requests are clipped
+ */
+void diskReadahead(Disk *disk, uint64_t offset, uint64_t size);
+
+/* Writes 'size' bytes at 'offset' to the file descriptor 'fd'
+ *
+ * Where the image on disk is up to date, the data is handed to the kernel to
+ * copy (sendfile) without passing through this process. Pages with unsaved
+ * changes, and descriptors sendfile can't write to, fall back to write()
+ * Returns false on failure
+ */
+bool diskSendTo(Disk *disk, int fd, uint64_t offset, uint64_t size);
+
+/* Sets the size of a block, which must be a power of two */
+void diskSetBlockSize(Disk *disk, size_t blockSize);
+
+/* Returns the offset of block 'blockno'
+ * Debug builds check that the block is on the disk
+ */
+static inline uint64_t diskBlockOffset(const Disk *disk, uint64_t blockno) {
+#ifndef NDEBUG
+	if( blockno >= (disk->size >> disk->blockShift) ) {
+		FATAL("block %" PRIu64 " is past the end of the disk\n", blockno);
+	}
+#endif
+
+	return blockno << disk->blockShift;
+}
+
+DiskBlock diskGetBlock(Disk *disk, uint64_t blockno);
+void diskReleaseBlock(Disk *disk, DiskBlock *block);
+
 void diskWrite8(Disk *disk, uint8_t data);
 void diskWrite16(Disk *disk, uint16_t data);
 void diskWrite32(Disk *disk, uint32_t data);
 void diskWrite64(Disk *disk, uint64_t data);
+void diskWriteBuf(Disk *disk, const void *src, size_t size);
 
-void diskSkip(Disk *disk, size_t skip);
+void diskSkip(Disk *disk, uint64_t skip);
 void diskCopy(Disk *disk, void *dest, size_t size);
 
-void diskRewind(Disk *disk, size_t pos);
-
-void diskSeek(Disk *disk, size_t pos);
+void diskSeek(Disk *disk, uint64_t pos);
 void diskSeekStart(Disk *disk);
 
-size_t diskGetPos(Disk *disk);
+uint64_t diskGetPos(Disk *disk);
 
+/* Gets the block cache counters
+ * Returns false if the disk isn't backed by a block cache
+ */
+bool diskGetCacheStats(Disk *disk, CacheStats *stats);
+
+/* Writes the whole image to 'FILEPATH'
+ * Saving over the image itself only writes the pages that changed
+ */
 void diskSave(Disk *disk, const char *FILEPATH);
 
+/* Writes only the pages that changed since the image was opened (or last saved
+ * in-place) to 'FILEPATH', which must be the image itself or a copy of it
+ * Passing NULL saves over the image. Returns false on failure
+ */
+bool diskSaveDirty(Disk *disk, const char *FILEPATH);
+
 #endif // !GUARD_EXT2P_DISK_H_
@@ -3,32 +3,131 @@
 
 #include <stdint.h>
 
+#include "balloc.h"
 #include "bg.h"
+#include "dcache.h"
 #include "dir.h"
 #include "disk.h"
+#include "icache.h"
 #include "inode.h"
 #include "util.h"
 
 /* Structure representing an ext2 filesystem */
 typedef struct _Ext2 {
 	Disk *disk;
+	ICache *icache;
+	DCache *dcache; /* Names looked up in directories */
+	BAlloc *balloc; /* Preallocation windows of files being extended */
 
 	size_t bgCount;
 	BlockGroup *bgs;
 } Ext2;
 
 Ext2 *ext2Open(const char *FILEPATH);
+
+/* Opens the image through a block cache holding at most 'cacheSize' bytes,
+ * instead of mapping it
+ */
+Ext2 *ext2OpenCached(const char *FILEPATH, size_t cacheSize);
+
 void ext2Free(Ext2 *ext2);
 
+/* Caps the memory used by decoded inodes at 'size' bytes */
+void ext2SetInodeCacheSize(Ext2 *ext2, size_t size);
+
 void ext2GetInode(Ext2 *ext2, uint32_t inodenum, Inode *inode);
 uint64_t ext2GetInodeSize(Ext2 *ext2, uint32_t inodenum, Inode *inode);
 
-bool ext2GetDir(Ext2 *ext2, uint32_t inodenum, Dir *dir);
-bool ext2ReadFile(Ext2 *ext2, uint32_t inodenum, FP *fp);
+/* Returns how many data blocks (not counting indirect blocks) are mapped */
+uint64_t ext2GetDataBlocks(Ext2 *ext2, uint32_t inodenum, Inode *inode);
+
+/* Reads all the entries of the directory 'inodenum' into 'list'
+ * The list has to be freed with 'dirListFree', even on failure
+ */
+bool ext2GetDir(Ext2 *ext2, uint32_t inodenum, DirList *list);
+
+/* Calls 'visit' on each entry of the directory 'inodenum' until it returns
+ * false, decoding entries straight out of their blocks
+ * The entry passed to 'visit' (name included) is only valid during the call
+ */
+bool ext2DirIterate(
+	Ext2 *ext2, uint32_t inodenum, DirVisitor visit, void *ctx
+);
+
+/* Finds the inode called 'NAME' in the directory 'parent'
+ * Lookups go through the dentry cache, so asking again for the same name
+ * (found or not) doesn't touch the directory. On success '*filetype' gets the
+ * entry's DIR_FT_* type
+ */
+bool ext2FindInode(
+	Ext2 *ext2, uint32_t parent, const char *NAME, uint32_t *inode,
+	uint8_t *filetype
+);
+
+/* Resolves 'PATH' to an inode, starting from the directory 'cwd'
+ * Paths starting with '/' start from the root instead, and '.' and '..' work
+ * as usual. Each component is one dentry cache lookup, so walking the same
+ * path again doesn't touch any directory. On success '*filetype' gets the
+ * DIR_FT_* type of what the path leads to
+ */
+bool ext2Lookup(
+	Ext2 *ext2, uint32_t cwd, const char *PATH, uint32_t *inode,
+	uint8_t *filetype
+);
+
+/* Returns the DIR_FT_* type of the entry 'dir'
+ * Entries only record their type with the filetype feature; without it, the
+ * type comes from the entry's inode
+ */
+uint8_t ext2GetFiletype(Ext2 *ext2, const Dir *dir);
 
-bool ext2DeleteFile(Ext2 *ext2, Dir *root, Dir *file);
-bool ext2DeleteDir(Ext2 *ext2, Dir *root, Dir *dir);
+/* Finds the entry called 'NAME' in the directory 'inodenum'
+ * On success, 'list' holds the entries of the block it was found in and
+ * '*entry' points at it. The list has to be freed with 'dirListFree'
+ */
+bool ext2FindEntry(
+	Ext2 *ext2, uint32_t inodenum, const char *NAME, DirList *list,
+	Dir **entry
+);
+
+/* Checks the free block and inode counts in the descriptors and the
+ * Superblock against the bitmaps, warning about each one that's off
+ * Returns true if they all match
+ */
+bool ext2CheckCounts(Ext2 *ext2);
+
+/* Allocates a data block for 'inodenum', as close after 'goal' as possible
+ * Pass the file's last block as 'goal' when extending it, so consecutive
+ * calls hand out consecutive blocks, or 0 to start from the inode's group.
+ * Call 'ext2CloseFile' once done. Returns 0 if there are no free blocks left
+ */
+uint32_t ext2AllocBlock(Ext2 *ext2, uint32_t inodenum, uint32_t goal);
+
+/* Ends a batch of allocations for 'inodenum': the blocks set aside for it are
+ * given back, and the Superblock's free count is written
+ */
+void ext2CloseFile(Ext2 *ext2, uint32_t inodenum);
+
+/* Appends 'count' zeroed blocks to the regular file 'inodenum'
+ * The file's size grows to cover them. Returns false if not all of them fit,
+ * in which case the file keeps the ones that did
+ */
+bool ext2ExtendFile(Ext2 *ext2, uint32_t inodenum, uint32_t count);
+
+/* Deletes 'file' from the directory 'parent'
+ * Its inode and blocks are only freed once no other entry links to it
+ */
+bool ext2DeleteFile(Ext2 *ext2, uint32_t parent, Dir *file);
+
+/* Deletes the directory 'dir', and everything under it, from 'parent'
+ * Freed inodes and blocks are gathered per group while the tree is walked, and
+ * each group's bitmaps and counts are written once at the end
+ */
+bool ext2DeleteDir(Ext2 *ext2, uint32_t parent, Dir *dir);
 
 void ext2SaveToFile(Ext2 *ext2, const char *FILEPATH);
 
+/* Writes only the blocks that changed to 'FILEPATH' (the image if NULL) */
+bool ext2SaveDirty(Ext2 *ext2, const char *FILEPATH);
+
 #endif // GUARD_EXT2P_EXT2_H_
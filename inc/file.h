@@ -0,0 +1,57 @@
+#ifndef GUARD_EXT2P_FILE_H_
+#define GUARD_EXT2P_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "blockmap.h"
+#include "disk.h"
+#include "ext2.h"
+#include "inode.h"
+
+/* Readahead window bounds, in bytes */
+#define FILE_READAHEAD_MIN (128 * 1024)
+#define FILE_READAHEAD_MAX (2 * 1024 * 1024)
+
+/* An open regular file
+ *
+ * Blocks are resolved as they're read, and a readahead window is kept ahead of
+ * sequential reads. Each handle has its own state, so different handles can
+ * be read from different threads
+ */
+typedef struct _Ext2File {
+	Disk *disk;
+	Inode inode;
+
+	uint64_t size; /* Size of the file in bytes */
+	uint32_t blockSize;
+	uint64_t blockCount; /* Logical blocks spanned by the file */
+
+	BlockMap map;
+	Extent extent; /* Last extent resolved (length 0 if none) */
+
+	uint64_t lastEnd; /* Offset right after the previous read */
+	uint64_t raEnd; /* Offset up to which readahead was requested */
+	uint64_t raWindow; /* Size of the next readahead request */
+} Ext2File;
+
+/* Opens the regular file at inode 'inodenum'
+ * Returns NULL if it isn't a regular file
+ */
+Ext2File *ext2FileOpen(Ext2 *ext2, uint32_t inodenum);
+void ext2FileClose(Ext2File *file);
+
+/* Reads up to 'size' bytes at 'offset' into 'dest'
+ * Returns the number of bytes read, which is 0 past the end of the file
+ */
+size_t ext2FileRead(Ext2File *file, uint64_t offset, void *dest, size_t size);
+
+/* Writes the whole file to the file descriptor 'fd'
+ *
+ * Extents are copied straight from the image by the kernel where possible
+ * (see 'diskSendTo'), and holes are written out as zeros
+ * Returns false on failure
+ */
+bool ext2FileSend(Ext2File *file, int fd);
+
+#endif // !GUARD_EXT2P_FILE_H_
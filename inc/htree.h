@@ -0,0 +1,78 @@
+#ifndef GUARD_EXT2P_HTREE_H_
+#define GUARD_EXT2P_HTREE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "blockmap.h"
+#include "disk.h"
+#include "superblock.h"
+
+/* Hash versions, as found in the Superblock and in the root of each index
+ * The unsigned variants are never stored, but picked when the Superblock says
+ * names were hashed as unsigned chars (see SB_FLAG_UNSIGNED_HASH)
+ */
+#define HTREE_HASH_LEGACY 0
+#define HTREE_HASH_HALF_MD4 1
+#define HTREE_HASH_TEA 2
+#define HTREE_HASH_LEGACY_UNSIGNED 3
+#define HTREE_HASH_HALF_MD4_UNSIGNED 4
+#define HTREE_HASH_TEA_UNSIGNED 5
+
+/* Levels of index blocks a tree can have, counting the root */
+#define HTREE_MAX_LEVELS 3
+
+/* An index block on the path from the root to a leaf */
+typedef struct _HTreeLevel {
+	DiskBlock block;
+	const char *entries; /* Entry table, starting with its count and limit */
+	uint16_t count; /* Entries in the table */
+	uint16_t at; /* Entry that was followed */
+} HTreeLevel;
+
+/* A lookup in the index of a directory (the "htree")
+ *
+ * Index entries map ranges of name hashes to the leaf blocks holding those
+ * names, so finding a name only reads one block per level plus its leaf
+ */
+typedef struct _HTree {
+	Disk *disk;
+	BlockMap *map; /* Maps the directory's blocks */
+
+	uint32_t hash; /* Hash of the name being looked up */
+
+	int depth; /* Levels in 'path' */
+	HTreeLevel path[HTREE_MAX_LEVELS];
+} HTree;
+
+/* Hashes a name the way directory indexes do
+ * 'SEED' is the Superblock's seed, with all zeroes meaning the default one
+ */
+uint32_t htreeHash(
+	const char *NAME, size_t len, int version, const uint32_t SEED[4]
+);
+
+/* Walks the index of a directory down to the leaf that should hold 'NAME'
+ * Returns false if the index can't be used, in which case the directory has to
+ * be scanned instead. Otherwise 'tree' must be freed with 'htreeFree'
+ */
+bool htreeFind(
+	HTree *tree, Disk *disk, BlockMap *map, const Superblock *sb,
+	const char *NAME
+);
+
+/* Returns the physical block of the leaf the lookup is at, or 0 if it's
+ * missing
+ */
+uint32_t htreeLeaf(HTree *tree);
+
+/* Moves on to the next leaf, if names with the same hash may have spilled
+ * over into it
+ * Returns false if there's nowhere else to look
+ */
+bool htreeNext(HTree *tree);
+
+void htreeFree(HTree *tree);
+
+#endif // !GUARD_EXT2P_HTREE_H_
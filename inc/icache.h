@@ -0,0 +1,67 @@
+#ifndef GUARD_EXT2P_ICACHE_H_
+#define GUARD_EXT2P_ICACHE_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "disk.h"
+#include "inode.h"
+#include "lru.h"
+
+/* Default memory budget of the inode cache, in bytes */
+#define ICACHE_DEFAULT_BUDGET (256 * 1024)
+
+/* A single decoded inode */
+typedef struct _ICacheEntry {
+	uint32_t inodenum;
+	Inode inode;
+	bool filling; /* Still being read from the image */
+	unsigned refs; /* Users currently holding the entry; never evicted */
+
+	LRUNode lru; /* Only entries nobody holds are on the LRU list */
+	struct _ICacheEntry *chain; /* Next entry in the same hash bucket */
+} ICacheEntry;
+
+/* Bounded LRU cache of inodes, keyed by inode number
+ *
+ * Inodes are read from the image the first time they're asked for, so memory
+ * use follows the inodes a session touches rather than the filesystem size.
+ * As in the block cache, the lock isn't held while an inode is read in.
+ * Changes have to be written back by whoever makes them
+ */
+typedef struct _ICache {
+	pthread_mutex_t lock;
+	pthread_cond_t filled; /* Signalled whenever an entry is done filling */
+
+	Disk *disk;
+
+	size_t budget; /* Max. bytes of entries kept in memory */
+	size_t used; /* Bytes of entries currently in memory */
+
+	ICacheEntry **buckets;
+	size_t bucketMask;
+
+	LRUList lru; /* Entries that can be evicted */
+
+	CacheStats stats;
+} ICache;
+
+ICache *icacheNew(Disk *disk, size_t budget);
+void icacheFree(ICache *icache);
+
+/* Returns the entry for inode 'inodenum', reading it from 'offset' into the
+ * image if needed
+ * The entry stays valid until it is given back with 'icacheRelease'
+ */
+ICacheEntry *icacheAcquire(ICache *icache, uint32_t inodenum, uint64_t offset);
+void icacheRelease(ICache *icache, ICacheEntry *entry);
+
+/* Changes the budget, evicting entries until they fit in it */
+void icacheSetBudget(ICache *icache, size_t budget);
+
+void icacheGetStats(ICache *icache, CacheStats *stats);
+
+#endif // !GUARD_EXT2P_ICACHE_H_
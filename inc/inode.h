@@ -2,6 +2,7 @@
 #define GUARD_EXT2_INODE_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "disk.h"
@@ -14,7 +15,14 @@
 #define INODE_RES_BOOT_LOADER 5
 #define INODE_RES_UNRM_DIR 6
 
+/* Indices into Inode.block */
+#define INODE_DIRECT_BLOCKS 12
+#define INODE_IND_BLOCK 12 /* Singly-indirect block */
+#define INODE_DIND_BLOCK 13 /* Doubly-indirect block */
+#define INODE_TIND_BLOCK 14 /* Triply-indirect block */
+
 /* Inode mode */
+#define INODE_FM_TYPE 0xF000 /* Bits holding one of the formats below */
 #define INODE_FM_SOCK 0xC000
 #define INODE_FM_SYMB 0xA000
 #define INODE_FM_FILE 0x8000
@@ -60,11 +68,14 @@
 #define INODE_FL_JOURNAL_DATA 0x00004000
 #define INODE_FL_RESERVED 0x80000000
 
+/* Magic number starting the block 'fileACL' points to */
+#define INODE_XATTR_MAGIC 0xEA020000
+
 typedef struct _Inode {
 	uint16_t mode; /* Format and access rights of the described file */
 	uint16_t uid; /* Unique ID of the file */
 
-	int32_t size_lo; /* Size of the file (low-bytes) */
+	uint32_t size_lo; /* Size of the file (low-bytes) */
 
 	int32_t accessTime; /* UNIX time of when the file was last accessed */
 	int32_t createTime; /* UNIX time of when the file was created */
@@ -117,6 +128,6 @@ typedef struct _Inode {
 	} osd2; /* OS-dependent value 2 */
 } Inode;
 
-bool inodeRead(Inode *inode, Disk *disk);
+bool inodeRead(Inode *inode, Disk *disk, uint64_t offset);
 
 #endif // !GUARD_EXT2_INODE_H_
@@ -0,0 +1,47 @@
+#ifndef GUARD_EXT2P_LRU_H_
+#define GUARD_EXT2P_LRU_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Intrusive LRU lists and hash table helpers, shared by the caches
+ *
+ * Cached structures embed an 'LRUNode' called 'lru', and get back from a node
+ * to themselves with 'LRU_ENTRY'. Their hash buckets chain through a pointer
+ * of their own, since keys differ from one cache to the next
+ */
+
+/* Gets the structure of type 'T' embedding the node 'N' as its 'lru' */
+#define LRU_ENTRY(N, T) ((T *)(void *)((char *)(N) - offsetof(T, lru)))
+
+typedef struct _LRUNode {
+	struct _LRUNode *prev; /* More recently used node */
+	struct _LRUNode *next; /* Less recently used node */
+} LRUNode;
+
+typedef struct _LRUList {
+	LRUNode *head; /* Most recently used node */
+	LRUNode *tail; /* Least recently used node, next to be evicted */
+} LRUList;
+
+void lruInit(LRUList *list);
+
+void lruUnlink(LRUList *list, LRUNode *node);
+void lruPushFront(LRUList *list, LRUNode *node);
+
+/* Moves 'node', which has to be on the list, to the front */
+void lruTouch(LRUList *list, LRUNode *node);
+
+/* Returns how many buckets a table holding up to 'entries' entries gets:
+ * about two per entry, and always a power of two
+ */
+size_t lruBucketCount(size_t entries);
+
+/* Fibonacci hashing, which spreads neighbouring keys across buckets
+ * 'mask' is the bucket count minus one
+ */
+static inline size_t lruHash(uint64_t key, size_t mask) {
+	return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+#endif // !GUARD_EXT2P_LRU_H_
@@ -2,8 +2,10 @@
 #define GUARD_EXT2P_SHELL_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "dir.h"
 #include "ext2.h"
 
 typedef struct _Shell {
@@ -11,7 +13,7 @@ typedef struct _Shell {
 
 	int pathLevel;
 	struct {
-		char name[255];
+		char name[DIR_NAME_MAX + 1];
 		uint32_t inode;
 	} path[128];
 
@@ -19,9 +21,13 @@ typedef struct _Shell {
 	int err;
 
 	Ext2 *fs;
+	size_t cacheSize; /* Block cache budget (0 maps images instead) */
+	size_t inodeCacheSize; /* Inode cache budget (0 for the default) */
 } Shell;
 
-Shell *shellOpen(const char *IMGPATH);
+Shell *shellOpen(
+	const char *IMGPATH, size_t cacheSize, size_t inodeCacheSize
+);
 void shellFree(Shell *shell);
 
 bool shellRun(Shell *shell);
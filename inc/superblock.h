@@ -13,7 +13,10 @@
 #define EXT2_REV0_FIRST_INODE 11
 #define EXT2_REV0_INODE_SIZE 128
 
-#define SB_SIZE 264
+#define SB_SIZE 356
+
+/* The Superblock always starts 1024 bytes into the image */
+#define SB_OFFSET 1024
 
 /* Compatible features bitmasks
  *
@@ -59,6 +62,15 @@
 #define SB_COMP_BZIP2 0x8
 #define SB_COMP_LZO 0x10
 
+/* Miscellaneous flags bitmasks
+ *
+ * The hash flags tell whether directory indexes were built treating names as
+ * signed or unsigned chars, which depends on the system that created them
+ */
+#define SB_FLAG_SIGNED_HASH 0x1
+#define SB_FLAG_UNSIGNED_HASH 0x2
+#define SB_FLAG_TEST_FS 0x4
+
 /* Enum containing all valid values of s_state
  * Represents the current state of the filesystem
  */
@@ -172,8 +184,24 @@ typedef struct _Superblock {
 	/* Other options */
 	uint32_t defaultMountOptions; /* TODO */
 	uint32_t firstMetaBlockGroup; /* TODO */
+
+	int32_t mkfsTime; /* UNIX timestamp of when the filesystem was created */
+	uint32_t journalBlocks[17]; /* Backup of the journal inode's blocks */
+
+	/* 64-bit block counts (ext4), unused here */
+	uint32_t blockCountHi;
+	uint32_t reservedBlocksCountHi;
+	uint32_t freeBlocksCountHi;
+
+	uint16_t minExtraInodeSize; /* Extra inode bytes every inode has */
+	uint16_t wantExtraInodeSize; /* Extra inode bytes new inodes should have */
+
+	uint32_t flags; /* Miscellaneous flags (see SB_FLAG_*) */
 } Superblock;
 
 bool sbRead(Superblock *sb, Disk *disk);
 
+/* Writes the Superblock back to its place in the image */
+void sbWrite(const Superblock *sb, Disk *disk);
+
 #endif // !GUARD_EXT2P_SUPERBLOCK_H_
@@ -1,10 +1,12 @@
 #ifndef GUARD_ELFP_UTIL_H_
 #define GUARD_ELFP_UTIL_H_
 
+#include <endian.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #define UNUSED(A) ((void)(A))
@@ -41,13 +43,46 @@ uint16_t utilRead16(bool le, FP *fp);
 uint32_t utilRead32(bool le, FP *fp);
 uint64_t utilRead64(bool le, FP *fp);
 
+/* Little-endian loads from possibly unaligned memory
+ *
+ * The caller is responsible for checking that the bytes are there; these are
+ * meant to decode the fields of a record that has been bounds-checked once
+ */
+static inline uint16_t utilLoad16(const void *src) {
+	uint16_t data;
+	memcpy(&data, src, sizeof(data));
+	return le16toh(data);
+}
+
+static inline uint32_t utilLoad32(const void *src) {
+	uint32_t data;
+	memcpy(&data, src, sizeof(data));
+	return le32toh(data);
+}
+
+static inline uint64_t utilLoad64(const void *src) {
+	uint64_t data;
+	memcpy(&data, src, sizeof(data));
+	return le64toh(data);
+}
+
 void utilWrite8(FILE *file, uint8_t data);
 void utilWrite16(FILE *file, uint16_t data);
 void utilWrite32(FILE *file, uint32_t data);
 void utilWrite64(FILE *file, uint64_t data);
 
+/* Writes all of 'src' to the file descriptor 'fd', retrying short writes
+ * Returns false on failure
+ */
+bool utilWriteAll(int fd, const void *src, size_t size);
+
 size_t utilFmtTime(time_t time, fmttime_t ftime);
 
+/* Parses a size such as "512", "64K" or "2G" into a byte count
+ * Returns false on failure
+ */
+bool utilParseSize(const char *STR, size_t *size);
+
 int utilLevenshtein(const char *A, const char *B);
 
 #endif // !GUARD_ELFP_UTIL_H_
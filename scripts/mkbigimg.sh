@@ -0,0 +1,89 @@
+#!/bin/sh
+# ext2p
+# Builds a sparse ext2 image over 4 GiB, to check that offsets stay 64-bit
+#
+# usage: mkbigimg.sh IMAGE [EXT2P]
+#
+# The image is 6 GiB but only takes a few megabytes on disk. It holds:
+#   far.txt     a small file whose only block is past the 4 GiB mark
+#   sparse.bin  a 3 GiB file that is all hole, except for its last line
+#   hello.txt   a small file near the start of the image
+#
+# If the path to an ext2p binary is given, the files are read back through it
+# (mapped and through the block cache) and checked. Needs mke2fs, debugfs and
+# e2fsck from e2fsprogs
+
+set -eu
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 IMAGE [EXT2P]" >&2
+	exit 2
+fi
+
+IMAGE=$1
+EXT2P=${2:-}
+
+BLOCK_SIZE=4096
+FAR_TEXT="past the 4 GiB mark"
+SPARSE_TEXT="end of the sparse file"
+
+TREE=$(mktemp -d)
+trap 'rm -rf "$TREE"' EXIT
+
+echo "hello" > "$TREE/hello.txt"
+echo "$FAR_TEXT" > "$TREE/far.txt"
+
+# Only the last line of the sparse file is data
+truncate -s 3G "$TREE/sparse.bin"
+SPARSE_TAIL=$((3 * 1024 * 1024 * 1024 - ${#SPARSE_TEXT} - 1))
+printf '%s\n' "$SPARSE_TEXT" \
+	| dd of="$TREE/sparse.bin" bs=1 seek=$SPARSE_TAIL conv=notrunc status=none
+
+rm -f "$IMAGE"
+truncate -s 6G "$IMAGE"
+mke2fs -q -F -t ext2 -b $BLOCK_SIZE -d "$TREE" "$IMAGE"
+
+# Move far.txt's block to a data block of group 36, 4.5 GiB into the image
+# (a group spans as many blocks as a block has bits). The group's bitmaps and
+# inode table come first, so skip well past them
+FAR=$((36 * 8 * BLOCK_SIZE + 1024))
+OLD=$(debugfs -R "bmap far.txt 0" "$IMAGE" 2>/dev/null)
+
+dd if="$IMAGE" of="$IMAGE" bs=$BLOCK_SIZE skip="$OLD" seek=$FAR count=1 \
+	conv=notrunc status=none
+
+debugfs -w "$IMAGE" >/dev/null 2>&1 <<-DEBUGFS
+	sif far.txt block[0] $FAR
+	setb $FAR
+	freeb $OLD
+DEBUGFS
+
+# debugfs leaves the free counts alone, so have e2fsck bring them in line
+e2fsck -fy "$IMAGE" >/dev/null 2>&1 || [ $? -eq 1 ]
+e2fsck -fn "$IMAGE" >/dev/null 2>&1
+
+echo "$IMAGE: far.txt is at block $FAR (offset $((FAR * BLOCK_SIZE)))"
+
+if [ -z "$EXT2P" ]; then
+	exit 0
+fi
+
+# Reads the files back through ext2p, with the options given
+check() {
+	OUT=$(printf 'cat far.txt\ncat hello.txt\nexit\n' | "$EXT2P" "$@" "$IMAGE")
+	echo "$OUT" | grep -q "$FAR_TEXT" || {
+		echo "far.txt came back wrong ($*)" >&2
+		exit 1
+	}
+
+	TAIL=$(printf 'cat sparse.bin\nexit\n' | "$EXT2P" "$@" "$IMAGE" | tail -c 64)
+	echo "$TAIL" | grep -q "$SPARSE_TEXT" || {
+		echo "sparse.bin came back wrong ($*)" >&2
+		exit 1
+	}
+}
+
+check
+check -c 1M
+
+echo "$IMAGE: read back fine, mapped and cached"
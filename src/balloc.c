@@ -0,0 +1,423 @@
+/* ext2p
+ * Block allocator
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bg.h"
+#include "bitmap.h"
+#include "disk.h"
+#include "fault.h"
+#include "lru.h"
+#include "superblock.h"
+#include "util.h"
+
+#include "balloc.h"
+
+static BAllocWindow *_findWindow(BAlloc *balloc, uint32_t inode);
+static BAllocWindow *_newWindow(BAlloc *balloc, uint32_t inode);
+static void _dropOthers(BAlloc *balloc, const BAllocWindow *KEEP);
+static uint32_t _windowSize(BAlloc *balloc, bool isDir);
+
+static bool _reserve(
+	BAlloc *balloc, BAllocWindow *window, uint32_t goal, uint32_t size
+);
+static bool _searchGroup(
+	BAlloc *balloc, size_t group, uint32_t from, uint32_t size,
+	uint32_t *found
+);
+static size_t _lowerBound(BAlloc *balloc, uint32_t blockno);
+static const BAllocWindow *_overlap(
+	BAlloc *balloc, uint32_t start, uint32_t end
+);
+static void _insert(BAlloc *balloc, BAllocWindow *window);
+static void _remove(BAlloc *balloc, BAllocWindow *window);
+static uint32_t _take(
+	BAlloc *balloc, BAllocWindow *window, uint32_t count
+);
+
+BAlloc *ballocNew(Disk *disk, BlockGroup *bgs, size_t bgCount) {
+	BAlloc *balloc = malloc(sizeof(*balloc));
+	if( balloc == NULL ) {
+		FATAL("couldn't allocate memory for block allocator\n");
+	}
+
+	balloc->disk = disk;
+	balloc->bgs = bgs;
+	balloc->bgCount = bgCount;
+
+	/* Only files being extended have a window, so there are never many */
+	balloc->buckets = calloc(BALLOC_BUCKETS, sizeof(*balloc->buckets));
+	if( balloc->buckets == NULL ) {
+		FATAL("couldn't allocate memory for allocation windows\n");
+	}
+
+	balloc->bucketMask = BALLOC_BUCKETS - 1;
+
+	balloc->sorted = NULL;
+	balloc->count = 0;
+	balloc->capacity = 0;
+
+	balloc->dirty = false;
+
+	return balloc;
+}
+
+void ballocFree(BAlloc *balloc) {
+	for( size_t i = 0; i <= balloc->bucketMask; ++i ) {
+		BAllocWindow *window = balloc->buckets[i];
+		while( window != NULL ) {
+			BAllocWindow *chain = window->chain;
+			free(window);
+			window = chain;
+		}
+	}
+
+	free(balloc->buckets);
+	free(balloc->sorted);
+	free(balloc);
+}
+
+uint32_t ballocAlloc(
+	BAlloc *balloc, uint32_t inode, bool isDir, uint32_t goal
+) {
+	uint32_t count = 1;
+	return ballocAllocRun(balloc, inode, isDir, goal, &count);
+}
+
+uint32_t ballocAllocRun(
+	BAlloc *balloc, uint32_t inode, bool isDir, uint32_t goal, uint32_t *count
+) {
+	const Superblock *SB = &balloc->bgs->sb;
+
+	/* The reserved blocks are kept for root, and ext2p never is */
+	if( SB->freeBlocksCount <= SB->reservedBlocksCount ) {
+		return 0;
+	}
+
+	const uint32_t WANT =
+		UTIL_MIN(*count, SB->freeBlocksCount - SB->reservedBlocksCount);
+
+	/* Without anything better, start with the group the inode is in */
+	if( goal < SB->firstDataBlock || goal >= SB->blockCount ) {
+		const uint32_t GROUP = (inode - 1) / SB->inodesPerGroup;
+		goal = SB->firstDataBlock + GROUP * SB->blocksPerGroup;
+	}
+
+	BAllocWindow *window = _findWindow(balloc, inode);
+	uint32_t size = _windowSize(balloc, isDir);
+
+	if( window != NULL ) {
+		/* Carrying on from the window, or from the end of it */
+		const bool SEQUENTIAL = goal + 1 >= window->start && goal < window->end;
+
+		if( SEQUENTIAL && window->next < window->end ) {
+			const uint32_t START = window->next;
+			if( (*count = _take(balloc, window, WANT)) > 0 ) {
+				return START;
+			}
+		}
+
+		/* A file that used up its window is likely to use up a bigger one */
+		size = window->size;
+		if( SEQUENTIAL && window->next == window->end ) {
+			size = UTIL_MIN(size * 2, BALLOC_MAX_WINDOW);
+		}
+
+		/* The window moves, so what's left of it is free for others again */
+		_remove(balloc, window);
+	} else {
+		window = _newWindow(balloc, inode);
+	}
+
+	/* Short of a whole window, any free block will do */
+	if( !_reserve(balloc, window, goal, size)
+		&& !_reserve(balloc, window, goal, 1) ) {
+		/* Other windows are only hints, so they go before the disk is full */
+		_dropOthers(balloc, window);
+
+		if( !_reserve(balloc, window, goal, 1) ) {
+			ballocDiscard(balloc, inode);
+			return 0;
+		}
+	}
+
+	window->size = size;
+	_insert(balloc, window);
+
+	const uint32_t START = window->next;
+	if( (*count = _take(balloc, window, WANT)) == 0 ) {
+		ballocDiscard(balloc, inode);
+		return 0;
+	}
+
+	return START;
+}
+
+void ballocDiscard(BAlloc *balloc, uint32_t inode) {
+	const size_t BUCKET = lruHash(inode, balloc->bucketMask);
+
+	BAllocWindow **link = &balloc->buckets[BUCKET];
+	while( *link != NULL && (*link)->inode != inode ) {
+		link = &(*link)->chain;
+	}
+
+	if( *link == NULL ) {
+		return;
+	}
+
+	BAllocWindow *window = *link;
+	*link = window->chain;
+
+	_remove(balloc, window);
+	free(window);
+}
+
+void ballocCommit(BAlloc *balloc) {
+	if( !balloc->dirty ) {
+		return;
+	}
+
+	sbWrite(&balloc->bgs->sb, balloc->disk);
+	balloc->dirty = false;
+}
+
+static BAllocWindow *_findWindow(BAlloc *balloc, uint32_t inode) {
+	const size_t BUCKET = lruHash(inode, balloc->bucketMask);
+
+	BAllocWindow *window = balloc->buckets[BUCKET];
+	while( window != NULL && window->inode != inode ) {
+		window = window->chain;
+	}
+
+	return window;
+}
+
+/* Creates an empty window for 'inode'; it only goes in 'sorted' once it has
+ * blocks set aside
+ */
+static BAllocWindow *_newWindow(BAlloc *balloc, uint32_t inode) {
+	BAllocWindow *window = malloc(sizeof(*window));
+	if( window == NULL ) {
+		FATAL("couldn't allocate memory for allocation window\n");
+	}
+
+	window->inode = inode;
+	window->start = 0;
+	window->end = 0;
+	window->next = 0;
+	window->size = 0;
+
+	const size_t BUCKET = lruHash(inode, balloc->bucketMask);
+	window->chain = balloc->buckets[BUCKET];
+	balloc->buckets[BUCKET] = window;
+
+	return window;
+}
+
+/* Drops every window but 'KEEP', which mustn't be in 'sorted' */
+static void _dropOthers(BAlloc *balloc, const BAllocWindow *KEEP) {
+	for( size_t i = 0; i <= balloc->bucketMask; ++i ) {
+		BAllocWindow **link = &balloc->buckets[i];
+		while( *link != NULL ) {
+			BAllocWindow *window = *link;
+			if( window == KEEP ) {
+				link = &window->chain;
+				continue;
+			}
+
+			*link = window->chain;
+			free(window);
+		}
+	}
+
+	balloc->count = 0;
+}
+
+/* Returns how many blocks a new window starts out with, going by the
+ * Superblock's preallocation counts
+ * Directories only get a window if the filesystem asks for it
+ */
+static uint32_t _windowSize(BAlloc *balloc, bool isDir) {
+	const Superblock *SB = &balloc->bgs->sb;
+
+	if( isDir ) {
+		const bool PREALLOC = SB->featuresCompat & SB_FC_DIR_PREALLOC;
+		return (PREALLOC && SB->preAllocBlocksD > 0) ? SB->preAllocBlocksD : 1;
+	}
+
+	return (SB->preAllocBlocksF > 0) ? SB->preAllocBlocksF
+									 : BALLOC_DEFAULT_WINDOW;
+}
+
+/* Points 'window' at 'size' free blocks nobody else has set aside, looking
+ * from 'goal' onwards through its group, then through the groups after it
+ */
+static bool _reserve(
+	BAlloc *balloc, BAllocWindow *window, uint32_t goal, uint32_t size
+) {
+	const Superblock *SB = &balloc->bgs->sb;
+	const size_t GROUP = (goal - SB->firstDataBlock) / SB->blocksPerGroup;
+	const uint32_t FROM = (goal - SB->firstDataBlock) % SB->blocksPerGroup;
+
+	/* The goal's group comes round again at the end, for what's before it */
+	for( size_t i = 0; i <= balloc->bgCount; ++i ) {
+		const size_t G = (GROUP + i) % balloc->bgCount;
+
+		/* Full groups are skipped without reading their bitmaps */
+		if( balloc->bgs[G].desc.freeBlocks < size ) {
+			continue;
+		}
+
+		uint32_t start;
+		if( _searchGroup(balloc, G, (i == 0) ? FROM : 0, size, &start) ) {
+			window->start = start;
+			window->end = start + size;
+			window->next = start;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Looks for 'size' free blocks in a row in 'group', from block index 'from'
+ * on, that aren't in any window
+ */
+static bool _searchGroup(
+	BAlloc *balloc, size_t group, uint32_t from, uint32_t size,
+	uint32_t *found
+) {
+	BlockGroup *bg = &balloc->bgs[group];
+
+	const char *BITMAP = bgGetBlockBitmap(bg);
+	const uint32_t BLOCKS = bgGetBlockCount(bg);
+	const uint32_t BASE =
+		bg->sb.firstDataBlock + (uint32_t)group * bg->sb.blocksPerGroup;
+
+	while( from < BLOCKS ) {
+		const size_t RUN = bitmapFindZeroRun(BITMAP, BLOCKS, from, size);
+		if( RUN == BITMAP_NONE ) {
+			return false;
+		}
+
+		const uint32_t START = BASE + (uint32_t)RUN;
+		const BAllocWindow *OTHER = _overlap(balloc, START, START + size);
+		if( OTHER == NULL ) {
+			*found = START;
+			return true;
+		}
+
+		/* Carry on past the window that's in the way */
+		from = OTHER->end - BASE;
+	}
+
+	return false;
+}
+
+/* Returns the index of the first window in 'sorted' that ends after
+ * 'blockno'
+ * Windows never overlap, so sorting them by first block sorts them by end too
+ */
+static size_t _lowerBound(BAlloc *balloc, uint32_t blockno) {
+	size_t lo = 0, hi = balloc->count;
+	while( lo < hi ) {
+		const size_t MID = lo + (hi - lo) / 2;
+		if( balloc->sorted[MID]->end <= blockno ) {
+			lo = MID + 1;
+		} else {
+			hi = MID;
+		}
+	}
+
+	return lo;
+}
+
+/* Returns a window overlapping blocks 'start' to 'end' */
+static const BAllocWindow *_overlap(
+	BAlloc *balloc, uint32_t start, uint32_t end
+) {
+	const size_t I = _lowerBound(balloc, start);
+	if( I < balloc->count && balloc->sorted[I]->start < end ) {
+		return balloc->sorted[I];
+	}
+
+	return NULL;
+}
+
+/* Adds 'window', which has just had blocks set aside, to 'sorted' */
+static void _insert(BAlloc *balloc, BAllocWindow *window) {
+	if( balloc->count == balloc->capacity ) {
+		const size_t CAPACITY = UTIL_MAX(balloc->capacity * 2, 16);
+
+		BAllocWindow **sorted =
+			realloc(balloc->sorted, CAPACITY * sizeof(*sorted));
+		if( sorted == NULL ) {
+			FATAL("couldn't allocate memory for allocation windows\n");
+		}
+
+		balloc->sorted = sorted;
+		balloc->capacity = CAPACITY;
+	}
+
+	const size_t I = _lowerBound(balloc, window->start);
+	memmove(
+		&balloc->sorted[I + 1], &balloc->sorted[I],
+		(balloc->count - I) * sizeof(*balloc->sorted)
+	);
+
+	balloc->sorted[I] = window;
+	++balloc->count;
+}
+
+/* Takes 'window' out of 'sorted', leaving it empty */
+static void _remove(BAlloc *balloc, BAllocWindow *window) {
+	if( window->start == window->end ) {
+		return;
+	}
+
+	/* Every window before it ends before it starts */
+	const size_t I = _lowerBound(balloc, window->start);
+	memmove(
+		&balloc->sorted[I], &balloc->sorted[I + 1],
+		(balloc->count - I - 1) * sizeof(*balloc->sorted)
+	);
+	--balloc->count;
+
+	window->start = 0;
+	window->end = 0;
+	window->next = 0;
+}
+
+/* Hands out up to 'count' blocks from where 'window' is at, marking them as
+ * used in their group and in the in-memory Superblock
+ * Windows never span two groups. Returns how many blocks were taken, which is
+ * none if any of them already were. The Superblock goes to disk in
+ * 'ballocCommit'
+ */
+static uint32_t _take(
+	BAlloc *balloc, BAllocWindow *window, uint32_t count
+) {
+	const Superblock *SB = &balloc->bgs->sb;
+	const uint32_t BLOCKNO = window->next;
+	const size_t GROUP = (BLOCKNO - SB->firstDataBlock) / SB->blocksPerGroup;
+
+	count = UTIL_MIN(count, window->end - BLOCKNO);
+	if( !bgTakeBlocks(&balloc->bgs[GROUP], BLOCKNO, count) ) {
+		return 0;
+	}
+
+	window->next += count;
+
+	/* The first group's Superblock is the one counts are read from and
+	 * written out
+	 */
+	balloc->bgs->sb.freeBlocksCount -= count;
+
+	balloc->dirty = true;
+	return count;
+}
@@ -11,74 +11,94 @@
 #include <time.h>
 
 #include "bgdescriptor.h"
+#include "bitmap.h"
+#include "blockmap.h"
 #include "dir.h"
 #include "disk.h"
 #include "fault.h"
+#include "htree.h"
+#include "icache.h"
 #include "inode.h"
 #include "superblock.h"
 #include "util.h"
 
 #include "bg.h"
 
-static bool _readBGTable(BlockGroup *bg, const uint32_t BLOCK_SIZE, Disk *disk);
+static void _initGroup(
+	uint32_t num, BlockGroup *bg, const char *DESC, Disk *disk, ICache *icache
+);
+static uint64_t _descriptorOffset(
+	Disk *disk, const Superblock *SB, uint32_t num
+);
+static char *_loadBitmap(BlockGroup *bg, uint32_t block);
 static uint32_t _inodeToIndex(BlockGroup *bg, uint32_t inodenum);
-
-bool bgRead(int num, BlockGroup *bg, Disk *disk) {
-	if( !sbRead(&bg->sb, disk) ) {
+static uint64_t _inodeOffset(BlockGroup *bg, uint32_t index);
+static ICacheEntry *_acquireInode(BlockGroup *bg, uint32_t inodenum);
+
+static bool _appendEntry(Dir *dir, void *list);
+static bool _searchBlock(
+	BlockGroup *bg, uint32_t blockno, const char *NAME, DirList *list,
+	Dir **entry
+);
+
+static void _removeEntry(BlockGroup *bg, const Dir *dir);
+static void _writeDescriptor(BlockGroup *bg);
+static void _writeInode(BlockGroup *bg, uint32_t index, const Inode *inode);
+static void _clearRun(BlockGroup *bg, BGFrees *frees);
+
+bool bgReadAll(BlockGroup *bgs, size_t count, Disk *disk, ICache *icache) {
+	if( count == 0 || !sbRead(&bgs->sb, disk) ) {
 		return false;
 	}
 
-	const uint32_t BLOCK_SIZE = (1024 << bg->sb.logBlockSize);
-
-	if( BLOCK_SIZE != 1024 ) {
-		diskSeek(disk, BLOCK_SIZE);
-	}
+	diskSetBlockSize(disk, 1024 << bgs->sb.logBlockSize);
 
-	diskSkip(disk, num * (BLOCK_SIZE / 32));
-	if( !_readBGTable(bg, BLOCK_SIZE, disk) ) {
-		return false;
+	/* The descriptors are back to back, so the whole table is one read */
+	const size_t SIZE = count * 32;
+	char *table = malloc(SIZE);
+	if( table == NULL ) {
+		FATAL("couldn't allocate memory for the descriptor table\n");
 	}
 
-	bg->data = diskClone(disk);
-	bg->blocksRead = diskGetPos(disk) / BLOCK_SIZE;
-
-	return true;
-}
-
-static bool
-_readBGTable(BlockGroup *bg, const uint32_t BLOCK_SIZE, Disk *disk) {
-	diskCopy(disk, &bg->desc, 32);
-
-	diskSeek(disk, BLOCK_SIZE * bg->desc.blockBitmap);
-	bg->blockBitmap = malloc(BLOCK_SIZE);
-	diskCopy(disk, bg->blockBitmap, BLOCK_SIZE);
-
-	diskSeek(disk, BLOCK_SIZE * bg->desc.inodeBitmap);
-	bg->inodeBitmap = malloc(BLOCK_SIZE);
-	diskCopy(disk, bg->inodeBitmap, BLOCK_SIZE);
+	diskReadAt(disk, _descriptorOffset(disk, &bgs->sb, 0), table, SIZE);
 
-	diskSeek(disk, BLOCK_SIZE * bg->desc.inodeTable);
-	bg->inodes = malloc(sizeof(*bg->inodes) * bg->sb.inodesPerGroup);
-	for( uint32_t i = 0; i < bg->sb.inodesPerGroup; ++i ) {
-		inodeRead(&bg->inodes[i], disk);
-		diskSkip(disk, bg->sb.inodeSize - 128);
+	for( size_t i = 0; i < count; ++i ) {
+		bgs[i].sb = bgs->sb;
+		_initGroup((uint32_t)i, &bgs[i], table + i * 32, disk, icache);
 	}
 
+	free(table);
 	return true;
 }
 
-bool bgReadAll(BlockGroup *bgs, Disk *disk) {
-	(void)bgs;
-	(void)disk;
+/* Sets up group 'num' from its descriptor, given that 'bg->sb' has already
+ * been filled in
+ */
+static void _initGroup(
+	uint32_t num, BlockGroup *bg, const char *DESC, Disk *disk, ICache *icache
+) {
+	memcpy(&bg->desc, DESC, 32);
+	bg->num = num;
+
+	/* Everything else is read when it's first needed */
+	bg->loaded = 0;
+	bg->blockBitmap = NULL;
+	bg->inodeBitmap = NULL;
+
+	bg->disk = disk;
+	bg->icache = icache;
+}
 
-	return true;
+/* The descriptor table starts on the block after the Superblock's */
+static uint64_t _descriptorOffset(
+	Disk *disk, const Superblock *SB, uint32_t num
+) {
+	return diskBlockOffset(disk, SB->firstDataBlock + 1) + (uint64_t)num * 32;
 }
 
 void bgFree(BlockGroup *bg) {
 	free(bg->blockBitmap);
 	free(bg->inodeBitmap);
-	free(bg->inodes);
-	free(bg->data);
 }
 
 void bgFreeAll(BlockGroup *bgs, size_t count) {
@@ -89,121 +109,481 @@ void bgFreeAll(BlockGroup *bgs, size_t count) {
 	free(bgs);
 }
 
+char *bgGetBlockBitmap(BlockGroup *bg) {
+	if( (bg->loaded & BG_LOADED_BLOCK_BITMAP) == 0 ) {
+		bg->blockBitmap = _loadBitmap(bg, bg->desc.blockBitmap);
+		bg->loaded |= BG_LOADED_BLOCK_BITMAP;
+	}
+
+	return bg->blockBitmap;
+}
+
+char *bgGetInodeBitmap(BlockGroup *bg) {
+	if( (bg->loaded & BG_LOADED_INODE_BITMAP) == 0 ) {
+		bg->inodeBitmap = _loadBitmap(bg, bg->desc.inodeBitmap);
+		bg->loaded |= BG_LOADED_INODE_BITMAP;
+	}
+
+	return bg->inodeBitmap;
+}
+
+/* Reads the bitmap held in 'block' */
+static char *_loadBitmap(BlockGroup *bg, uint32_t block) {
+	const uint32_t BLOCK_SIZE = (1024 << bg->sb.logBlockSize);
+
+	char *bitmap = malloc(BLOCK_SIZE);
+	if( bitmap == NULL ) {
+		FATAL("couldn't allocate memory for bitmap\n");
+	}
+
+	diskReadAt(bg->disk, diskBlockOffset(bg->disk, block), bitmap, BLOCK_SIZE);
+	return bitmap;
+}
+
+void bgGetStats(const BlockGroup *bgs, size_t count, BGStats *stats) {
+	stats->groups = count;
+	stats->blockBitmaps = 0;
+	stats->inodeBitmaps = 0;
+
+	for( size_t i = 0; i < count; ++i ) {
+		const uint8_t LOADED = bgs[i].loaded;
+
+		stats->blockBitmaps += (LOADED & BG_LOADED_BLOCK_BITMAP) != 0;
+		stats->inodeBitmaps += (LOADED & BG_LOADED_INODE_BITMAP) != 0;
+	}
+}
+
+uint32_t bgGetBlockCount(const BlockGroup *bg) {
+	/* The last group gets whatever blocks are left */
+	const uint32_t FIRST =
+		bg->sb.firstDataBlock + bg->num * bg->sb.blocksPerGroup;
+	return UTIL_MIN(bg->sb.blocksPerGroup, bg->sb.blockCount - FIRST);
+}
+
+void bgCountFree(BlockGroup *bg, uint32_t *freeBlocks, uint32_t *freeInodes) {
+	const uint32_t BLOCKS = bgGetBlockCount(bg);
+	const uint32_t INODES = bg->sb.inodesPerGroup;
+
+	*freeBlocks = BLOCKS - bitmapCount(bgGetBlockBitmap(bg), BLOCKS);
+	*freeInodes = INODES - bitmapCount(bgGetInodeBitmap(bg), INODES);
+}
+
 void bgGetInode(BlockGroup *bg, uint32_t inodenum, Inode *inode) {
-	inodenum = _inodeToIndex(bg, inodenum);
-	*inode = bg->inodes[inodenum];
+	ICacheEntry *entry = _acquireInode(bg, inodenum);
+	*inode = entry->inode;
+	icacheRelease(bg->icache, entry);
+}
+
+void bgSetInode(BlockGroup *bg, uint32_t inodenum, const Inode *inode) {
+	ICacheEntry *entry = _acquireInode(bg, inodenum);
+	entry->inode = *inode;
+
+	_writeInode(bg, _inodeToIndex(bg, inodenum), &entry->inode);
+	icacheRelease(bg->icache, entry);
 }
 
 uint64_t bgGetInodeSize(BlockGroup *bg, Inode *inode) {
 	if( bg->sb.revLevel == SB_REV_DYNAMIC ) {
-		return ((uint64_t)(inode->size_hi) << 32) | (uint64_t)inode->size_lo;
+		return ((uint64_t)inode->size_hi << 32) | inode->size_lo;
 	} else {
 		return inode->size_lo;
 	}
 }
 
-bool bgGetDir(BlockGroup *bg, uint32_t inodenum, Dir *dir) {
-	inodenum = _inodeToIndex(bg, inodenum);
-	Inode *inode = &bg->inodes[inodenum];
+bool bgGetDir(BlockGroup *bg, uint32_t inodenum, DirList *list) {
+	/* Leave an empty list behind on failure, so it can still be freed */
+	dirListInit(list);
 
-	if( (inode->mode & INODE_FM_DIR) == 0 ) {
-		ERR("tried to get contents of non-directory inode\n");
+	if( !bgDirIterate(bg, inodenum, _appendEntry, list) ) {
 		return false;
 	}
 
-	if( (inode->flags & INODE_FL_INDEX_DIR) ) {
-		WARN("dir indexing not implemented, falling back to linked list\n");
+	if( list->count == 0 ) {
+		ERR("directory has no entries\n");
+		return false;
 	}
 
-	diskSeek(bg->data, bgOffsetBlock(bg, inode->block[0]));
-	dirReadLinkedList(bg->data, (1024 << bg->sb.logBlockSize), dir);
-
 	return true;
 }
 
-bool bgReadFile(BlockGroup *bg, uint32_t inodenum, FP *fp) {
-	inodenum = _inodeToIndex(bg, inodenum);
-	Inode *inode = &bg->inodes[inodenum];
+bool bgDirIterate(
+	BlockGroup *bg, uint32_t inodenum, DirVisitor visit, void *ctx
+) {
+	Inode inode;
+	bgGetInode(bg, inodenum, &inode);
 
-	if( (inode->mode & INODE_FM_FILE) == 0 ) {
-		ERR("tried to get contents of non-file inode\n");
+	if( (inode.mode & INODE_FM_DIR) == 0 ) {
+		ERR("tried to get contents of non-directory inode\n");
 		return false;
 	}
 
-	uint64_t size = bgGetInodeSize(bg, inode);
+	/* Indexed directories are still laid out as a list of entries (the index
+	 * hides in entries the list skips over), so the same walk reads them
+	 */
+	const uint32_t BLOCK_SIZE = (1024 << bg->sb.logBlockSize);
 
-	fp->_start = malloc(size);
-	fp->data = fp->_start;
-	fp->size = size;
+	BlockMap map;
+	blockmapInit(&map, bg->disk, BLOCK_SIZE, &inode);
 
-	uint64_t bytesRead = 0;
-	uint32_t maxblock = inode->blocks / (2 << bg->sb.logBlockSize);
+	const uint64_t BLOCK_COUNT =
+		blockmapBlockCount(&map, bgGetInodeSize(bg, &inode));
 
-	for( uint32_t i = 0; i < maxblock; ++i ) {
-		diskSeek(bg->data, bgOffsetBlock(bg, inode->block[i]));
+	bool more = true;
 
-		for( int j = 0; j < (1024 << bg->sb.logBlockSize); ++j ) {
-			fp->data[bytesRead++] = diskRead8(bg->data);
-			if( bytesRead >= size ) {
-				break;
+	Extent extent;
+	uint64_t next = 0;
+	while( more && blockmapGetExtent(&map, next, BLOCK_COUNT, &extent) ) {
+		next += extent.length;
+		if( EXTENT_IS_HOLE(&extent) ) {
+			continue;
+		}
+
+		/* Have the rest of the run on its way while it's being decoded */
+		diskReadahead(
+			bg->disk, diskBlockOffset(bg->disk, extent.physical),
+			extent.length * BLOCK_SIZE
+		);
+
+		for( uint32_t i = 0; more && i < extent.length; ++i ) {
+			const uint32_t BLOCKNO = extent.physical + i;
+
+			DiskBlock block = diskGetBlock(bg->disk, BLOCKNO);
+
+			DirCursor cursor;
+			dirCursorInit(&cursor, block.data, block.size, BLOCKNO);
+
+			Dir dir;
+			while( more && dirCursorNext(&cursor, &dir) ) {
+				more = visit(&dir, ctx);
 			}
+
+			diskReleaseBlock(bg->disk, &block);
 		}
 	}
 
+	blockmapFree(&map);
 	return true;
 }
 
-void bgDeleteFile(BlockGroup *bg, Dir *root, Dir *dir) {
-	uint32_t inodenum = _inodeToIndex(bg, dir->inode);
-	Inode *inode = &bg->inodes[inodenum];
+bool bgFindEntry(
+	BlockGroup *bg, uint32_t inodenum, const char *NAME, DirList *list,
+	Dir **entry
+) {
+	dirListInit(list);
+	*entry = NULL;
 
-	bg->inodeBitmap[inodenum >> 3] &= ~(1 << (inodenum % 8));
-	memset(inode, 0, 128);
+	Inode inode;
+	bgGetInode(bg, inodenum, &inode);
 
-	Inode *rootInode = &bg->inodes[_inodeToIndex(bg, root->inode)];
-	diskSeek(bg->data, bgOffsetBlock(bg, rootInode->block[0]));
-	diskSkip(bg->data, dir->offset);
+	if( (inode.mode & INODE_FM_DIR) == 0 ) {
+		ERR("tried to look up a name in non-directory inode\n");
+		return false;
+	}
 
-	rootInode->size_lo -= 4 + dir->nextEntry;
-	inode->deleteTime = time(NULL);
+	const uint32_t BLOCK_SIZE = (1024 << bg->sb.logBlockSize);
 
-	if( dir->next == NULL ) {
-		diskWrite32(bg->data, 0);
-		return;
+	BlockMap map;
+	blockmapInit(&map, bg->disk, BLOCK_SIZE, &inode);
+
+	/* "." and ".." are always at the start, and aren't in the index */
+	if( strcmp(NAME, ".") == 0 || strcmp(NAME, "..") == 0 ) {
+		const bool FOUND =
+			_searchBlock(bg, blockmapGet(&map, 0), NAME, list, entry);
+
+		blockmapFree(&map);
+		return FOUND;
+	}
+
+	bool found = false;
+
+	HTree tree;
+	if( (inode.flags & INODE_FL_INDEX_DIR)
+		&& (bg->sb.featuresCompat & SB_FC_DIR_INDEXING)
+		&& htreeFind(&tree, bg->disk, &map, &bg->sb, NAME) ) {
+		do {
+			found = _searchBlock(bg, htreeLeaf(&tree), NAME, list, entry);
+		} while( !found && htreeNext(&tree) );
+
+		htreeFree(&tree);
+		blockmapFree(&map);
+		return found;
 	}
 
-	/* Shift directory entries down */
-	while( true ) {
-		dir = dir->next;
-		if( dir == NULL ) {
-			break;
+	const uint64_t BLOCK_COUNT =
+		blockmapBlockCount(&map, bgGetInodeSize(bg, &inode));
+
+	Extent extent;
+	uint64_t next = 0;
+	while( !found && blockmapGetExtent(&map, next, BLOCK_COUNT, &extent) ) {
+		next += extent.length;
+		if( EXTENT_IS_HOLE(&extent) ) {
+			continue;
 		}
 
-		diskWrite32(bg->data, dir->inode);
-		diskWrite16(bg->data, dir->nextEntry);
-		diskWrite8(bg->data, dir->nameLen);
-		diskWrite8(bg->data, dir->filetype);
+		diskReadahead(
+			bg->disk, diskBlockOffset(bg->disk, extent.physical),
+			extent.length * BLOCK_SIZE
+		);
 
-		for( uint8_t i = 0; i < dir->nameLen; ++i ) {
-			diskWrite8(bg->data, dir->filename[i]);
+		for( uint32_t i = 0; !found && i < extent.length; ++i ) {
+			found = _searchBlock(bg, extent.physical + i, NAME, list, entry);
 		}
+	}
+
+	blockmapFree(&map);
+	return found;
+}
+
+uint64_t bgGetDataBlocks(BlockGroup *bg, Inode *inode) {
+	const uint32_t BLOCK_SIZE = (1024 << bg->sb.logBlockSize);
+
+	BlockMap map;
+	blockmapInit(&map, bg->disk, BLOCK_SIZE, inode);
+
+	const uint64_t BLOCK_COUNT =
+		blockmapBlockCount(&map, bgGetInodeSize(bg, inode));
+	const uint64_t COUNT = blockmapCountMapped(&map, BLOCK_COUNT);
+
+	blockmapFree(&map);
+	return COUNT;
+}
 
-		diskRewind(bg->data, 8 + dir->nameLen);
-		diskSkip(bg->data, dir->nextEntry);
+void bgUnlink(
+	BlockGroup *parentBg, uint32_t parent, const Dir *dir, bool isDir
+) {
+	_removeEntry(parentBg, dir);
+
+	/* The directory keeps its size; only its contents changed. A
+	 * subdirectory's '..' linked back to it, and that's gone too
+	 */
+	ICacheEntry *entry = _acquireInode(parentBg, parent);
+	entry->inode.modifyTime = time(NULL);
+	if( isDir && entry->inode.linkCount > 0 ) {
+		--entry->inode.linkCount;
 	}
+
+	_writeInode(parentBg, _inodeToIndex(parentBg, parent), &entry->inode);
+	icacheRelease(parentBg->icache, entry);
 }
 
-void bgDeleteDir(BlockGroup *bg, Dir *root, Dir *dir) {
-	uint32_t inodenum = _inodeToIndex(bg, dir->inode);
-	Inode *inode = &bg->inodes[inodenum];
+bool bgReleaseInode(
+	BlockGroup *bg, uint32_t inodenum, bool isDir, Inode *inode,
+	BGFrees *frees
+) {
+	const uint32_t INDEX = _inodeToIndex(bg, inodenum);
+	ICacheEntry *entry = _acquireInode(bg, inodenum);
+
+	/* Files that are linked elsewhere too just lose a link */
+	if( !isDir && entry->inode.linkCount > 1 ) {
+		--entry->inode.linkCount;
+		_writeInode(bg, INDEX, &entry->inode);
+
+		icacheRelease(bg->icache, entry);
+		return false;
+	}
 
-	UNUSED(inode);
+	*inode = entry->inode;
+
+	memset(&entry->inode, 0, sizeof(entry->inode));
+	entry->inode.deleteTime = time(NULL);
+	_writeInode(bg, INDEX, &entry->inode);
+	icacheRelease(bg->icache, entry);
+
+	bitmapClear(bgGetInodeBitmap(bg), INDEX);
+
+	++frees->inodes;
+	frees->dirs += isDir;
+
+	return true;
+}
+
+void bgReleaseBlock(BlockGroup *bg, uint32_t blockno, BGFrees *frees) {
+	const uint32_t INDEX =
+		(blockno - bg->sb.firstDataBlock) % bg->sb.blocksPerGroup;
+
+	if( frees->runLength > 0
+		&& INDEX != frees->runStart + frees->runLength ) {
+		_clearRun(bg, frees);
+	}
+
+	if( frees->runLength == 0 ) {
+		frees->runStart = INDEX;
+	}
+
+	++frees->runLength;
+	++frees->blocks;
+}
+
+void bgCommitFrees(BlockGroup *bg, BGFrees *frees) {
+	const uint32_t BLOCK_SIZE = (1024 << bg->sb.logBlockSize);
+
+	_clearRun(bg, frees);
+
+	if( frees->inodes > 0 ) {
+		diskSeek(bg->disk, diskBlockOffset(bg->disk, bg->desc.inodeBitmap));
+		diskWriteBuf(bg->disk, bgGetInodeBitmap(bg), BLOCK_SIZE);
+	}
+
+	if( frees->blocks > 0 ) {
+		diskSeek(bg->disk, diskBlockOffset(bg->disk, bg->desc.blockBitmap));
+		diskWriteBuf(bg->disk, bgGetBlockBitmap(bg), BLOCK_SIZE);
+	}
+
+	if( frees->inodes == 0 && frees->blocks == 0 ) {
+		return;
+	}
+
+	bg->desc.freeInodes += frees->inodes;
+	bg->desc.freeBlocks += frees->blocks;
+	bg->desc.dirInodes -= UTIL_MIN(frees->dirs, bg->desc.dirInodes);
+
+	_writeDescriptor(bg);
+	memset(frees, 0, sizeof(*frees));
+}
+
+bool bgTakeBlocks(BlockGroup *bg, uint32_t blockno, uint32_t count) {
+	const uint32_t INDEX =
+		(blockno - bg->sb.firstDataBlock) % bg->sb.blocksPerGroup;
+
+	/* The run is free if it's the first free run at its own start */
+	char *bitmap = bgGetBlockBitmap(bg);
+	if( bg->desc.freeBlocks < count
+		|| bitmapFindZeroRun(bitmap, INDEX + count, INDEX, count) != INDEX ) {
+		return false;
+	}
+
+	bitmapSetRange(bitmap, INDEX, count);
+	bg->desc.freeBlocks -= count;
+
+	const uint32_t FIRST_BYTE = INDEX >> 3;
+	const uint32_t LAST_BYTE = (INDEX + count - 1) >> 3;
+
+	diskSeek(bg->disk, diskBlockOffset(bg->disk, bg->desc.blockBitmap));
+	diskSkip(bg->disk, FIRST_BYTE);
+	diskWriteBuf(bg->disk, bitmap + FIRST_BYTE, LAST_BYTE - FIRST_BYTE + 1);
+
+	_writeDescriptor(bg);
+	return true;
 }
 
 static uint32_t _inodeToIndex(BlockGroup *bg, uint32_t inodenum) {
 	return (inodenum - 1) % bg->sb.inodesPerGroup;
 }
 
-uint32_t bgOffsetBlock(BlockGroup *bg, uint32_t block) {
-	return (block - bg->blocksRead) * (1024 << bg->sb.logBlockSize);
+/* Returns where the inode at 'index' in the group's inode table is */
+static uint64_t _inodeOffset(BlockGroup *bg, uint32_t index) {
+	return diskBlockOffset(bg->disk, bg->desc.inodeTable)
+		+ (uint64_t)index * bg->sb.inodeSize;
+}
+
+/* Gets inode 'inodenum' from the inode cache; give it back with
+ * 'icacheRelease'
+ */
+static ICacheEntry *_acquireInode(BlockGroup *bg, uint32_t inodenum) {
+	const uint64_t OFFSET = _inodeOffset(bg, _inodeToIndex(bg, inodenum));
+	return icacheAcquire(bg->icache, inodenum, OFFSET);
+}
+
+/* Looks for 'NAME' in directory block 'blockno'
+ * If it's there, 'list' is filled with the block's entries and '*entry' is set
+ * to the one that matched; otherwise 'list' is left alone
+ */
+static bool _searchBlock(
+	BlockGroup *bg, uint32_t blockno, const char *NAME, DirList *list,
+	Dir **entry
+) {
+	if( blockno == 0 ) {
+		return false;
+	}
+
+	DiskBlock block = diskGetBlock(bg->disk, blockno);
+
+	DirCursor cursor;
+	dirCursorInit(&cursor, block.data, block.size, blockno);
+
+	Dir dir;
+	bool found = false;
+	while( !found && dirCursorNext(&cursor, &dir) ) {
+		found = strcmp(dir.filename, NAME) == 0;
+	}
+
+	/* Only the block that has the name is kept */
+	if( found ) {
+		dirListClear(list);
+		dirReadBlock(block.data, block.size, blockno, list);
+
+		for( size_t i = 0; i < list->count; ++i ) {
+			if( list->entries[i].offset == dir.offset ) {
+				*entry = &list->entries[i];
+				break;
+			}
+		}
+	}
+
+	diskReleaseBlock(bg->disk, &block);
+	return found;
+}
+
+/* Visitor that copies each entry into the DirList 'list' */
+static bool _appendEntry(Dir *dir, void *list) {
+	dirListAppend(list, dir);
+	return true;
+}
+
+/* Unlinks 'dir' from its block the way ext2 does: the entry before it grows
+ * over it, or if it's first in the block, it's marked unused
+ * Nothing else in the block moves, so this is cheap however big the directory
+ */
+static void _removeEntry(BlockGroup *bg, const Dir *dir) {
+	const uint64_t BLOCK = diskBlockOffset(bg->disk, dir->block);
+
+	if( dir->offset == 0 ) {
+		diskSeek(bg->disk, BLOCK);
+		diskWrite32(bg->disk, 0);
+		return;
+	}
+
+	/* Entries only link forwards, so the one before has to be found by
+	 * walking the block (unused entries included)
+	 */
+	DiskBlock block = diskGetBlock(bg->disk, dir->block);
+
+	uint32_t prev = 0;
+	uint16_t prevLen = utilLoad16(block.data + 4);
+	while( prev + prevLen < dir->offset && prevLen != 0 ) {
+		prev += prevLen;
+		prevLen = utilLoad16(block.data + prev + 4);
+	}
+
+	diskReleaseBlock(bg->disk, &block);
+
+	if( prev + prevLen != dir->offset ) {
+		WARN("directory block %" PRIu32 " is corrupt\n", dir->block);
+		return;
+	}
+
+	diskSeek(bg->disk, BLOCK + prev + 4);
+	diskWrite16(bg->disk, prevLen + dir->nextEntry);
+}
+
+/* Writes the group's descriptor back to the descriptor table */
+static void _writeDescriptor(BlockGroup *bg) {
+	diskSeek(bg->disk, _descriptorOffset(bg->disk, &bg->sb, bg->num));
+	diskWriteBuf(bg->disk, &bg->desc, 32);
+}
+
+/* Writes an inode back to the inode table */
+static void _writeInode(BlockGroup *bg, uint32_t index, const Inode *inode) {
+	diskSeek(bg->disk, _inodeOffset(bg, index));
+	diskWriteBuf(bg->disk, inode, 128);
+}
+
+/* Clears the run of blocks 'frees' has gathered in the block bitmap */
+static void _clearRun(BlockGroup *bg, BGFrees *frees) {
+	if( frees->runLength == 0 ) {
+		return;
+	}
+
+	bitmapClearRange(bgGetBlockBitmap(bg), frees->runStart, frees->runLength);
+	frees->runLength = 0;
 }
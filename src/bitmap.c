@@ -0,0 +1,230 @@
+/* ext2p
+ * Bitmap
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "util.h"
+
+#include "bitmap.h"
+
+static uint64_t _load(const char *bits, size_t nbits, size_t word);
+static size_t _find(const char *bits, size_t nbits, size_t start, bool set);
+static uint64_t _word(
+	const char *bits, size_t nbits, size_t word, uint64_t flip
+);
+static size_t _skip(
+	const char *bits, size_t nbits, size_t word, uint64_t flip
+);
+static int _popcount(uint64_t word);
+static int _ctz(uint64_t word);
+
+bool bitmapTest(const char *bits, size_t bit) {
+	return (bits[bit >> 3] >> (bit & 7)) & 1;
+}
+
+void bitmapSet(char *bits, size_t bit) {
+	bits[bit >> 3] |= 1 << (bit & 7);
+}
+
+void bitmapClear(char *bits, size_t bit) {
+	bits[bit >> 3] &= ~(1 << (bit & 7));
+}
+
+void bitmapSetRange(char *bits, size_t start, size_t count) {
+	/* Bits up to the first whole byte, whole bytes, then what's left */
+	while( count > 0 && (start & 7) != 0 ) {
+		bitmapSet(bits, start++);
+		--count;
+	}
+
+	memset(bits + (start >> 3), 0xFF, count >> 3);
+	start += count & ~(size_t)7;
+
+	for( count &= 7; count > 0; --count ) {
+		bitmapSet(bits, start++);
+	}
+}
+
+void bitmapClearRange(char *bits, size_t start, size_t count) {
+	while( count > 0 && (start & 7) != 0 ) {
+		bitmapClear(bits, start++);
+		--count;
+	}
+
+	memset(bits + (start >> 3), 0, count >> 3);
+	start += count & ~(size_t)7;
+
+	for( count &= 7; count > 0; --count ) {
+		bitmapClear(bits, start++);
+	}
+}
+
+size_t bitmapCount(const char *bits, size_t nbits) {
+	size_t count = 0;
+
+	/* Whole words straight from the buffer, then whatever is left over */
+	const size_t WHOLE = nbits / 64;
+	for( size_t w = 0; w < WHOLE; ++w ) {
+		count += _popcount(utilLoad64(bits + w * 8));
+	}
+
+	if( nbits % 64 != 0 ) {
+		count += _popcount(_load(bits, nbits, WHOLE));
+	}
+
+	return count;
+}
+
+size_t bitmapFindZero(const char *bits, size_t nbits, size_t start) {
+	return _find(bits, nbits, start, false);
+}
+
+size_t bitmapFindZeroRun(
+	const char *bits, size_t nbits, size_t start, size_t len
+) {
+	while( true ) {
+		const size_t FIRST = bitmapFindZero(bits, nbits, start);
+		if( FIRST == BITMAP_NONE || nbits - FIRST < len ) {
+			return BITMAP_NONE;
+		}
+
+		/* The run ends at the next set bit, if that comes soon enough */
+		const size_t END = _find(bits, FIRST + len, FIRST, true);
+		if( END == BITMAP_NONE ) {
+			return FIRST;
+		}
+
+		start = END + 1;
+	}
+}
+
+/* Returns the 64 bits starting at bit 'word * 64', with bits past 'nbits'
+ * cleared
+ */
+static uint64_t _load(const char *bits, size_t nbits, size_t word) {
+	const size_t FIRST = word * 64;
+	const size_t BYTES = (nbits + 7) / 8;
+
+	uint64_t data;
+	if( FIRST / 8 + 8 <= BYTES ) {
+		data = utilLoad64(bits + FIRST / 8);
+	} else {
+		char tail[8] = { 0 };
+		memcpy(tail, bits + FIRST / 8, BYTES - FIRST / 8);
+		data = utilLoad64(tail);
+	}
+
+	if( nbits - FIRST < 64 ) {
+		data &= (UINT64_C(1) << (nbits - FIRST)) - 1;
+	}
+
+	return data;
+}
+
+/* Returns the first bit at or after 'start' that's set (or clear, if 'set'
+ * is false), or BITMAP_NONE
+ */
+static size_t _find(const char *bits, size_t nbits, size_t start, bool set) {
+	if( start >= nbits ) {
+		return BITMAP_NONE;
+	}
+
+	/* Looking for clear bits is looking for set bits in the inverse */
+	const uint64_t FLIP = set ? 0 : ~UINT64_C(0);
+	const size_t WORDS = (nbits + 63) / 64;
+
+	/* Nothing before 'start' counts */
+	size_t w = start / 64;
+	uint64_t data =
+		_word(bits, nbits, w, FLIP) & (~UINT64_C(0) << (start % 64));
+
+	while( data == 0 ) {
+		w = _skip(bits, nbits, w + 1, FLIP);
+		if( w >= WORDS ) {
+			return BITMAP_NONE;
+		}
+
+		data = _word(bits, nbits, w, FLIP);
+	}
+
+	return w * 64 + _ctz(data);
+}
+
+/* Returns word 'word', flipped by XORing it with 'flip'
+ * Bits past 'nbits' come back clear either way
+ */
+static uint64_t _word(
+	const char *bits, size_t nbits, size_t word, uint64_t flip
+) {
+	if( (word + 1) * 64 <= nbits ) {
+		return utilLoad64(bits + word * 8) ^ flip;
+	}
+
+	return (_load(bits, nbits, word) ^ flip)
+		& ((UINT64_C(1) << (nbits - word * 64)) - 1);
+}
+
+/* Returns the first word from 'word' on that isn't all 'flip', or where the
+ * whole words end
+ * With SSE2, 16 bytes are checked at once; full or empty stretches of a
+ * bitmap go by twice as fast as a word at a time
+ */
+static size_t _skip(
+	const char *bits, size_t nbits, size_t word, uint64_t flip
+) {
+	const size_t WHOLE = nbits / 64;
+
+#if defined(__SSE2__)
+	const __m128i EMPTY = _mm_set1_epi8((char)(flip & 0xFF));
+	while( word + 2 <= WHOLE ) {
+		const __m128i DATA =
+			_mm_loadu_si128((const __m128i *)(const void *)(bits + word * 8));
+		if( _mm_movemask_epi8(_mm_cmpeq_epi8(DATA, EMPTY)) != 0xFFFF ) {
+			break;
+		}
+
+		word += 2;
+	}
+#endif
+
+	while( word < WHOLE && (utilLoad64(bits + word * 8) ^ flip) == 0 ) {
+		++word;
+	}
+
+	return word;
+}
+
+static int _popcount(uint64_t word) {
+#if defined(__GNUC__)
+	return __builtin_popcountll(word);
+#else
+	word -= (word >> 1) & UINT64_C(0x5555555555555555);
+	word = (word & UINT64_C(0x3333333333333333))
+		+ ((word >> 2) & UINT64_C(0x3333333333333333));
+	word = (word + (word >> 4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+	return (int)((word * UINT64_C(0x0101010101010101)) >> 56);
+#endif
+}
+
+/* Index of the lowest set bit; 'word' can't be 0 */
+static int _ctz(uint64_t word) {
+#if defined(__GNUC__)
+	return __builtin_ctzll(word);
+#else
+	int n = 0;
+	while( (word & 1) == 0 ) {
+		word >>= 1;
+		++n;
+	}
+
+	return n;
+#endif
+}
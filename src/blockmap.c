@@ -0,0 +1,192 @@
+/* ext2p
+ * Inode block map
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "disk.h"
+#include "fault.h"
+#include "inode.h"
+#include "util.h"
+
+#include "blockmap.h"
+
+static uint32_t _lookup(BlockMap *map, uint64_t index, uint64_t *run);
+static uint32_t _walk(
+	BlockMap *map, uint32_t block, int levels, uint64_t index, uint64_t *run
+);
+static const uint32_t *_load(BlockMap *map, int depth, uint32_t block);
+
+void blockmapInit(
+	BlockMap *map, Disk *disk, uint32_t blockSize, const Inode *inode
+) {
+	map->disk = disk;
+	map->inode = inode;
+
+	map->blockSize = blockSize;
+	map->perBlock = blockSize / sizeof(uint32_t);
+
+	for( int i = 0; i < BLOCKMAP_LEVELS; ++i ) {
+		map->slots[i].block = 0;
+		map->slots[i].ptrs = NULL;
+	}
+}
+
+void blockmapFree(BlockMap *map) {
+	for( int i = 0; i < BLOCKMAP_LEVELS; ++i ) {
+		free(map->slots[i].ptrs);
+		map->slots[i].ptrs = NULL;
+	}
+}
+
+uint32_t blockmapGet(BlockMap *map, uint64_t index) {
+	uint64_t run;
+	return _lookup(map, index, &run);
+}
+
+bool blockmapGetExtent(
+	BlockMap *map, uint64_t index, uint64_t end, Extent *extent
+) {
+	if( index >= end ) {
+		return false;
+	}
+
+	uint64_t run;
+	extent->logical = index;
+	extent->physical = _lookup(map, index, &run);
+	extent->length = 1;
+
+	if( EXTENT_IS_HOLE(extent) ) {
+		/* Skip over whole unmapped subtrees at a time */
+		extent->length = run;
+		while( index + extent->length < end
+			   && _lookup(map, index + extent->length, &run) == 0 ) {
+			extent->length += run;
+		}
+
+		extent->length = UTIL_MIN(extent->length, end - index);
+		return true;
+	}
+
+	while( index + extent->length < end ) {
+		const uint32_t NEXT = blockmapGet(map, index + extent->length);
+		if( NEXT != extent->physical + extent->length ) {
+			break;
+		}
+
+		++extent->length;
+	}
+
+	return true;
+}
+
+uint64_t blockmapCountMapped(BlockMap *map, uint64_t end) {
+	uint64_t count = 0;
+
+	Extent extent;
+	uint64_t index = 0;
+	while( blockmapGetExtent(map, index, end, &extent) ) {
+		if( !EXTENT_IS_HOLE(&extent) ) {
+			count += extent.length;
+		}
+
+		index += extent.length;
+	}
+
+	return count;
+}
+
+uint64_t blockmapBlockCount(BlockMap *map, uint64_t size) {
+	return (size + map->blockSize - 1) / map->blockSize;
+}
+
+/* Returns the physical block for logical block 'index'
+ *
+ * If it's a hole, 'run' is set to how many blocks from 'index' onwards are
+ * known to be holes too; otherwise it's 1
+ */
+static uint32_t _lookup(BlockMap *map, uint64_t index, uint64_t *run) {
+	const uint64_t PER_BLOCK = map->perBlock;
+	const uint32_t *BLOCK = map->inode->block;
+
+	*run = 1;
+	if( index < INODE_DIRECT_BLOCKS ) {
+		return BLOCK[index];
+	}
+
+	index -= INODE_DIRECT_BLOCKS;
+	if( index < PER_BLOCK ) {
+		return _walk(map, BLOCK[INODE_IND_BLOCK], 1, index, run);
+	}
+
+	index -= PER_BLOCK;
+	if( index < PER_BLOCK * PER_BLOCK ) {
+		return _walk(map, BLOCK[INODE_DIND_BLOCK], 2, index, run);
+	}
+
+	index -= PER_BLOCK * PER_BLOCK;
+	if( index < PER_BLOCK * PER_BLOCK * PER_BLOCK ) {
+		return _walk(map, BLOCK[INODE_TIND_BLOCK], 3, index, run);
+	}
+
+	return 0;
+}
+
+/* Follows 'levels' indirect blocks down from 'block'
+ * A zero pointer on the way down makes the rest of its subtree a hole
+ */
+static uint32_t _walk(
+	BlockMap *map, uint32_t block, int levels, uint64_t index, uint64_t *run
+) {
+	uint64_t span = 1;
+	for( int i = 1; i < levels; ++i ) {
+		span *= map->perBlock;
+	}
+
+	/* Blocks mapped by 'block', of which we're at 'index' */
+	uint64_t subtree = span * map->perBlock;
+
+	for( int depth = 0; depth < levels; ++depth ) {
+		if( block == 0 ) {
+			*run = subtree - index;
+			return 0;
+		}
+
+		const uint32_t *PTRS = _load(map, depth, block);
+
+		block = PTRS[index / span];
+		index %= span;
+		subtree = span;
+		span /= map->perBlock;
+	}
+
+	return block;
+}
+
+/* Returns the decoded pointers of an indirect block, reading it if the slot
+ * for its depth holds a different one
+ */
+static const uint32_t *_load(BlockMap *map, int depth, uint32_t block) {
+	BlockMapSlot *slot = &map->slots[depth];
+	if( slot->block == block ) {
+		return slot->ptrs;
+	}
+
+	if( slot->ptrs == NULL ) {
+		slot->ptrs = malloc(map->blockSize);
+		if( slot->ptrs == NULL ) {
+			FATAL("couldn't allocate memory for indirect block\n");
+		}
+	}
+
+	DiskBlock data = diskGetBlock(map->disk, block);
+	for( uint32_t i = 0; i < map->perBlock; ++i ) {
+		slot->ptrs[i] = utilLoad32(data.data + i * sizeof(uint32_t));
+	}
+	diskReleaseBlock(map->disk, &data);
+
+	slot->block = block;
+	return slot->ptrs;
+}
@@ -0,0 +1,267 @@
+/* ext2p
+ * Block cache
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "fault.h"
+#include "lru.h"
+#include "util.h"
+
+#include "cache.h"
+
+static void _hold(Cache *cache, CacheLine *line);
+
+static bool _evict(Cache *cache);
+static void _removeFromBucket(Cache *cache, CacheLine *line);
+
+static bool _fill(Cache *cache, CacheLine *line);
+
+Cache *cacheNew(int fd, uint64_t fileSize, size_t lineSize, size_t budget) {
+	Cache *cache = malloc(sizeof(*cache));
+	if( cache == NULL ) {
+		FATAL("couldn't allocate memory for block cache\n");
+	}
+
+	cache->fd = fd;
+	cache->fileSize = fileSize;
+
+	cache->lineSize = lineSize;
+	cache->budget = UTIL_MAX(budget, lineSize);
+	cache->used = 0;
+
+	const size_t BUCKETS = lruBucketCount(cache->budget / lineSize);
+	cache->buckets = calloc(BUCKETS, sizeof(*cache->buckets));
+	if( cache->buckets == NULL ) {
+		FATAL("couldn't allocate memory for block cache\n");
+	}
+
+	cache->bucketMask = BUCKETS - 1;
+	lruInit(&cache->lru);
+
+	memset(&cache->stats, 0, sizeof(cache->stats));
+	pthread_mutex_init(&cache->lock, NULL);
+	pthread_cond_init(&cache->filled, NULL);
+
+	return cache;
+}
+
+void cacheFree(Cache *cache) {
+	/* Lines in use or dirty aren't on the LRU list, but every line is in a
+	 * bucket
+	 */
+	for( size_t i = 0; i <= cache->bucketMask; ++i ) {
+		CacheLine *line = cache->buckets[i];
+		while( line != NULL ) {
+			CacheLine *chain = line->chain;
+
+			free(line->data);
+			free(line);
+
+			line = chain;
+		}
+	}
+
+	pthread_mutex_destroy(&cache->lock);
+	pthread_cond_destroy(&cache->filled);
+
+	free(cache->buckets);
+	free(cache);
+}
+
+CacheLine *cacheAcquire(Cache *cache, uint64_t index) {
+	pthread_mutex_lock(&cache->lock);
+
+	CacheLine *line = cachePeek(cache, index);
+	if( line != NULL ) {
+		++cache->stats.hits;
+		_hold(cache, line);
+
+		pthread_mutex_unlock(&cache->lock);
+		return line;
+	}
+
+	++cache->stats.misses;
+
+	while( cache->used + cache->lineSize > cache->budget ) {
+		if( !_evict(cache) ) {
+			/* Everything left is dirty or in use */
+			break;
+		}
+	}
+
+	line = malloc(sizeof(*line));
+	if( line == NULL ) {
+		FATAL("couldn't allocate memory for cache line\n");
+	}
+
+	line->data = malloc(cache->lineSize);
+	if( line->data == NULL ) {
+		FATAL("couldn't allocate memory for cache line\n");
+	}
+
+	line->index = index;
+	line->dirty = false;
+	line->filling = true;
+	line->refs = 1;
+
+	/* Held lines stay off the LRU list, but others can find this one */
+	const size_t BUCKET = lruHash(index, cache->bucketMask);
+	line->chain = cache->buckets[BUCKET];
+	cache->buckets[BUCKET] = line;
+
+	cache->used += cache->lineSize;
+
+	pthread_mutex_unlock(&cache->lock);
+
+	if( !_fill(cache, line) ) {
+		FATAL("couldn't read block %" PRIu64 " from image\n", index);
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	line->filling = false;
+	pthread_cond_broadcast(&cache->filled);
+	pthread_mutex_unlock(&cache->lock);
+
+	return line;
+}
+
+CacheLine *cacheAcquireCached(Cache *cache, uint64_t index) {
+	pthread_mutex_lock(&cache->lock);
+
+	CacheLine *line = cachePeek(cache, index);
+	if( line != NULL ) {
+		++cache->stats.hits;
+		_hold(cache, line);
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+	return line;
+}
+
+void cacheRelease(Cache *cache, CacheLine *line) {
+	pthread_mutex_lock(&cache->lock);
+
+	/* Once nobody holds it, a clean line can be evicted again */
+	if( --line->refs == 0 && !line->dirty ) {
+		lruPushFront(&cache->lru, &line->lru);
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+CacheLine *cachePeek(Cache *cache, uint64_t index) {
+	CacheLine *line = cache->buckets[lruHash(index, cache->bucketMask)];
+	while( line != NULL && line->index != index ) {
+		line = line->chain;
+	}
+
+	return line;
+}
+
+void cacheMarkDirty(Cache *cache, CacheLine *line) {
+	pthread_mutex_lock(&cache->lock);
+	line->dirty = true;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void cacheMarkClean(Cache *cache) {
+	pthread_mutex_lock(&cache->lock);
+
+	for( size_t i = 0; i <= cache->bucketMask; ++i ) {
+		for( CacheLine *line = cache->buckets[i]; line != NULL;
+			 line = line->chain ) {
+			if( line->dirty && line->refs == 0 ) {
+				lruPushFront(&cache->lru, &line->lru);
+			}
+
+			line->dirty = false;
+		}
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void cacheGetStats(Cache *cache, CacheStats *stats) {
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* Takes a reference to 'line', waiting for it if it's still being read in
+ * Called with the lock held
+ */
+static void _hold(Cache *cache, CacheLine *line) {
+	if( line->refs++ == 0 && !line->dirty ) {
+		lruUnlink(&cache->lru, &line->lru);
+	}
+
+	while( line->filling ) {
+		pthread_cond_wait(&cache->filled, &cache->lock);
+	}
+}
+
+/* Drops the least recently used clean, unused line
+ * Returns false if there's no such line
+ */
+static bool _evict(Cache *cache) {
+	if( cache->lru.tail == NULL ) {
+		return false;
+	}
+
+	CacheLine *line = LRU_ENTRY(cache->lru.tail, CacheLine);
+	lruUnlink(&cache->lru, &line->lru);
+	_removeFromBucket(cache, line);
+
+	free(line->data);
+	free(line);
+
+	cache->used -= cache->lineSize;
+	++cache->stats.evictions;
+
+	return true;
+}
+
+static void _removeFromBucket(Cache *cache, CacheLine *line) {
+	CacheLine **link = &cache->buckets[lruHash(line->index, cache->bucketMask)];
+	while( *link != line ) {
+		link = &(*link)->chain;
+	}
+
+	*link = line->chain;
+}
+
+/* Reads the line's block from the image, zero-filling past the end of it */
+static bool _fill(Cache *cache, CacheLine *line) {
+	const uint64_t START = line->index * cache->lineSize;
+
+	size_t done = 0;
+	while( done < cache->lineSize && START + done < cache->fileSize ) {
+		const ssize_t READ = pread(
+			cache->fd, line->data + done, cache->lineSize - done,
+			(off_t)(START + done)
+		);
+
+		if( READ < 0 ) {
+			return false;
+		}
+
+		if( READ == 0 ) {
+			break;
+		}
+
+		done += READ;
+	}
+
+	memset(line->data + done, 0, cache->lineSize - done);
+	return true;
+}
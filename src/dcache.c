@@ -0,0 +1,198 @@
+/* ext2p
+ * Dentry cache
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "dir.h"
+#include "fault.h"
+#include "lru.h"
+#include "util.h"
+
+#include "dcache.h"
+
+/* Names are usually short, so buckets are sized for entries of about this
+ * many bytes
+ */
+#define DCACHE_TYPICAL_ENTRY (sizeof(DCacheEntry) + 16)
+
+static size_t _hash(DCache *dcache, uint32_t parent, const char *NAME);
+static DCacheEntry *_find(
+	DCache *dcache, uint32_t parent, const char *NAME, size_t len
+);
+static size_t _entrySize(const DCacheEntry *entry);
+
+static void _shrink(DCache *dcache, size_t budget);
+static void _remove(DCache *dcache, DCacheEntry *entry);
+
+DCache *dcacheNew(size_t budget) {
+	DCache *dcache = malloc(sizeof(*dcache));
+	if( dcache == NULL ) {
+		FATAL("couldn't allocate memory for dentry cache\n");
+	}
+
+	dcache->budget = UTIL_MAX(budget, DCACHE_TYPICAL_ENTRY);
+	dcache->used = 0;
+
+	const size_t BUCKETS =
+		lruBucketCount(dcache->budget / DCACHE_TYPICAL_ENTRY);
+	dcache->buckets = calloc(BUCKETS, sizeof(*dcache->buckets));
+	if( dcache->buckets == NULL ) {
+		FATAL("couldn't allocate memory for dentry cache\n");
+	}
+
+	dcache->bucketMask = BUCKETS - 1;
+	lruInit(&dcache->lru);
+
+	memset(&dcache->stats, 0, sizeof(dcache->stats));
+	return dcache;
+}
+
+void dcacheFree(DCache *dcache) {
+	LRUNode *node = dcache->lru.head;
+	while( node != NULL ) {
+		LRUNode *next = node->next;
+		free(LRU_ENTRY(node, DCacheEntry));
+		node = next;
+	}
+
+	free(dcache->buckets);
+	free(dcache);
+}
+
+bool dcacheLookup(
+	DCache *dcache, uint32_t parent, const char *NAME, uint32_t *inode,
+	uint8_t *filetype
+) {
+	DCacheEntry *entry = _find(dcache, parent, NAME, strlen(NAME));
+	if( entry == NULL ) {
+		++dcache->stats.misses;
+		return false;
+	}
+
+	++dcache->stats.hits;
+
+	lruTouch(&dcache->lru, &entry->lru);
+
+	*inode = entry->inode;
+	*filetype = entry->filetype;
+
+	return true;
+}
+
+void dcacheInsert(
+	DCache *dcache, uint32_t parent, const char *NAME, uint32_t inode,
+	uint8_t filetype
+) {
+	const size_t LEN = strlen(NAME);
+
+	/* No entry can have a name this long, so there's nothing to remember */
+	if( LEN > DIR_NAME_MAX ) {
+		return;
+	}
+
+	DCacheEntry *entry = _find(dcache, parent, NAME, LEN);
+	if( entry != NULL ) {
+		_remove(dcache, entry);
+	}
+
+	const size_t SIZE = sizeof(*entry) + LEN + 1;
+	_shrink(dcache, dcache->budget > SIZE ? dcache->budget - SIZE : 0);
+
+	entry = malloc(SIZE);
+	if( entry == NULL ) {
+		FATAL("couldn't allocate memory for dentry\n");
+	}
+
+	entry->parent = parent;
+	entry->inode = inode;
+	entry->filetype = filetype;
+	entry->nameLen = (uint8_t)LEN;
+	memcpy(entry->name, NAME, LEN + 1);
+
+	const size_t BUCKET = _hash(dcache, parent, NAME);
+	entry->chain = dcache->buckets[BUCKET];
+	dcache->buckets[BUCKET] = entry;
+
+	lruPushFront(&dcache->lru, &entry->lru);
+	dcache->used += SIZE;
+}
+
+void dcacheForgetDir(DCache *dcache, uint32_t parent) {
+	LRUNode *node = dcache->lru.head;
+	while( node != NULL ) {
+		LRUNode *next = node->next;
+
+		DCacheEntry *entry = LRU_ENTRY(node, DCacheEntry);
+		if( entry->parent == parent ) {
+			_remove(dcache, entry);
+		}
+
+		node = next;
+	}
+}
+
+void dcacheGetStats(DCache *dcache, CacheStats *stats) {
+	*stats = dcache->stats;
+}
+
+static size_t _hash(DCache *dcache, uint32_t parent, const char *NAME) {
+	/* FNV-1a over the name, starting from the parent so that the same name in
+	 * different directories lands in different buckets
+	 */
+	uint64_t hash = 0xCBF29CE484222325ULL ^ parent;
+	for( const char *c = NAME; *c != '\0'; ++c ) {
+		hash ^= (uint8_t)*c;
+		hash *= 0x100000001B3ULL;
+	}
+
+	return (size_t)(hash ^ (hash >> 32)) & dcache->bucketMask;
+}
+
+static DCacheEntry *_find(
+	DCache *dcache, uint32_t parent, const char *NAME, size_t len
+) {
+	DCacheEntry *entry = dcache->buckets[_hash(dcache, parent, NAME)];
+	while( entry != NULL
+		   && (entry->parent != parent || entry->nameLen != len
+			   || memcmp(entry->name, NAME, len) != 0) ) {
+		entry = entry->chain;
+	}
+
+	return entry;
+}
+
+static size_t _entrySize(const DCacheEntry *entry) {
+	return sizeof(*entry) + entry->nameLen + 1;
+}
+
+/* Evicts the least recently used entries until at most 'budget' bytes are in
+ * use
+ */
+static void _shrink(DCache *dcache, size_t budget) {
+	while( dcache->used > budget && dcache->lru.tail != NULL ) {
+		_remove(dcache, LRU_ENTRY(dcache->lru.tail, DCacheEntry));
+		++dcache->stats.evictions;
+	}
+}
+
+/* Unlinks an entry from its bucket and the LRU list, and frees it */
+static void _remove(DCache *dcache, DCacheEntry *entry) {
+	DCacheEntry **link =
+		&dcache->buckets[_hash(dcache, entry->parent, entry->name)];
+	while( *link != entry ) {
+		link = &(*link)->chain;
+	}
+
+	*link = entry->chain;
+
+	lruUnlink(&dcache->lru, &entry->lru);
+	dcache->used -= _entrySize(entry);
+
+	free(entry);
+}
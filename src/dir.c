@@ -2,83 +2,138 @@
  * Directory
  */
 
+#include <inttypes.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "dir.h"
 #include "disk.h"
+#include "fault.h"
+#include "util.h"
 
-Dir *dirNew(void) {
-	Dir *dir = malloc(sizeof(*dir));
-	return dir;
+static Dir *_append(DirList *list, uint8_t nameLen);
+static void _growNames(DirList *list, size_t needed);
+
+bool dirDecodeEntry(const char *data, size_t size, Dir *dir) {
+	if( size < DIR_ENTRY_HEADER_SIZE ) {
+		return false;
+	}
+
+	const uint8_t NAME_LEN = (uint8_t)data[6];
+	const uint16_t REC_LEN = utilLoad16(data + 4);
+
+	/* A record always has room for its own name, and nothing else can be in
+	 * the way
+	 */
+	if( REC_LEN < DIR_ENTRY_HEADER_SIZE + NAME_LEN || REC_LEN > size ) {
+		return false;
+	}
+
+	dir->inode = utilLoad32(data);
+	dir->nextEntry = REC_LEN;
+	dir->nameLen = NAME_LEN;
+	dir->filetype = (uint8_t)data[7];
+
+	return true;
 }
 
-void dirReadLinkedList(Disk *disk, uint32_t blockSize, Dir *dir) {
-	Dir *prev = dir;
-	Dir *curr = dir;
-
-	uint32_t sentinel = 0;
-	while( true ) {
-		uint32_t ino = diskRead32(disk);
-		if( ino == 0 ) {
-			free(prev->next);
-			prev->next = NULL;
-			break;
-		}
+void dirListInit(DirList *list) {
+	list->entries = NULL;
+	list->count = 0;
+	list->capacity = 0;
 
-		curr->offset = sentinel;
+	list->names = NULL;
+	list->namesSize = 0;
+	list->namesCapacity = 0;
+}
 
-		curr->inode = ino;
-		curr->nextEntry = diskRead16(disk);
-		curr->nameLen = diskRead8(disk);
-		curr->filetype = diskRead8(disk);
+void dirListClear(DirList *list) {
+	list->count = 0;
+	list->namesSize = 0;
+}
 
-		curr->filename = malloc(curr->nameLen + 1);
-		for( uint8_t i = 0; i < curr->nameLen; ++i ) {
-			curr->filename[i] = diskRead8(disk);
-		}
-		curr->filename[curr->nameLen] = '\0';
+void dirListFree(DirList *list) {
+	free(list->entries);
+	free(list->names);
 
-		sentinel += curr->nextEntry;
-		if( sentinel >= blockSize ) {
-			curr->next = NULL;
-			break;
-		}
+	dirListInit(list);
+}
 
-		diskRewind(disk, 8 + curr->nameLen);
-		diskSkip(disk, curr->nextEntry);
+void dirListAppend(DirList *list, const Dir *dir) {
+	Dir *copy = _append(list, dir->nameLen);
+	char *name = copy->filename;
 
-		curr->next = dirNew();
+	*copy = *dir;
+	copy->filename = name;
 
-		prev = curr;
-		curr = curr->next;
-	}
+	memcpy(name, dir->filename, dir->nameLen);
+	name[dir->nameLen] = '\0';
 }
 
-void dirFreeLinkedList(Dir *dir) {
-	free(dir->filename);
+void dirCursorInit(
+	DirCursor *cursor, const char *block, uint32_t blockSize, uint32_t blockno
+) {
+	cursor->block = block;
+	cursor->blockSize = blockSize;
+	cursor->blockno = blockno;
+	cursor->at = 0;
+}
 
-	if( dir->next == NULL ) {
-		return;
-	}
+bool dirCursorNext(DirCursor *cursor, Dir *dir) {
+	while( cursor->at < cursor->blockSize ) {
+		const char *ENTRY = cursor->block + cursor->at;
+
+		if( !dirDecodeEntry(ENTRY, cursor->blockSize - cursor->at, dir) ) {
+			WARN(
+				"bad directory entry in block %" PRIu32 "\n", cursor->blockno
+			);
+
+			cursor->at = cursor->blockSize;
+			return false;
+		}
 
-	dir = dir->next;
-	Dir *next = dir->next;
-	while( true ) {
-		free(dir->filename);
-		free(dir);
-		dir = next;
+		const uint32_t OFFSET = cursor->at;
+		cursor->at += dir->nextEntry;
 
-		if( dir == NULL ) {
-			return;
+		/* Deleted entries, and the empty ones that pad out index blocks */
+		if( dir->inode == 0 ) {
+			continue;
 		}
-		next = dir->next;
+
+		dir->block = cursor->blockno;
+		dir->offset = OFFSET;
+
+		memcpy(cursor->name, ENTRY + DIR_ENTRY_HEADER_SIZE, dir->nameLen);
+		cursor->name[dir->nameLen] = '\0';
+		dir->filename = cursor->name;
+
+		return true;
+	}
+
+	return false;
+}
+
+void dirReadBlock(
+	const char *block, uint32_t blockSize, uint32_t blockno, DirList *list
+) {
+	DirCursor cursor;
+	dirCursorInit(&cursor, block, blockSize, blockno);
+
+	Dir dir;
+	while( dirCursorNext(&cursor, &dir) ) {
+		dirListAppend(list, &dir);
 	}
 }
 
 char *dirGetFiletype(Dir *dir) {
-	switch( dir->filetype ) {
+	return dirFiletypeName(dir->filetype);
+}
+
+char *dirFiletypeName(uint8_t filetype) {
+	switch( filetype ) {
 	case DIR_FT_UNKNOWN:
 		return "unknown";
 	case DIR_FT_FILE:
@@ -99,3 +154,58 @@ char *dirGetFiletype(Dir *dir) {
 
 	return "invalid";
 }
+
+/* Adds an entry to the end of a list, with room for a name of 'nameLen' bytes
+ * The entry's filename points at that room
+ */
+static Dir *_append(DirList *list, uint8_t nameLen) {
+	if( list->count == list->capacity ) {
+		const size_t CAPACITY = UTIL_MAX(list->capacity * 2, 64);
+
+		Dir *entries = realloc(list->entries, CAPACITY * sizeof(*entries));
+		if( entries == NULL ) {
+			FATAL("couldn't allocate memory for directory entries\n");
+		}
+
+		list->entries = entries;
+		list->capacity = CAPACITY;
+	}
+
+	const size_t NEEDED = list->namesSize + nameLen + 1;
+	if( NEEDED > list->namesCapacity ) {
+		_growNames(list, NEEDED);
+	}
+
+	Dir *dir = &list->entries[list->count++];
+	dir->filename = list->names + list->namesSize;
+	list->namesSize = NEEDED;
+
+	return dir;
+}
+
+/* Moves the name pool somewhere with room for at least 'needed' bytes */
+static void _growNames(DirList *list, size_t needed) {
+	size_t capacity = UTIL_MAX(list->namesCapacity * 2, 1024);
+	while( capacity < needed ) {
+		capacity *= 2;
+	}
+
+	char *names = malloc(capacity);
+	if( names == NULL ) {
+		FATAL("couldn't allocate memory for directory names\n");
+	}
+
+	if( list->namesSize > 0 ) {
+		memcpy(names, list->names, list->namesSize);
+	}
+
+	/* Entries point into the pool, so they have to follow it */
+	for( size_t i = 0; i < list->count; ++i ) {
+		Dir *dir = &list->entries[i];
+		dir->filename = names + (dir->filename - list->names);
+	}
+
+	free(list->names);
+	list->names = names;
+	list->namesCapacity = capacity;
+}
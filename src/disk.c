@@ -2,25 +2,61 @@
  * Disk emulator
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cache.h"
 #include "fault.h"
 #include "util.h"
 
 #include "disk.h"
 
+/* Largest range handed to sendfile at once, so the count fits a size_t */
+#define DISK_SEND_SIZE (1024 * 1024 * 1024)
+
+static bool _mapImage(Disk *disk, const char *FILEPATH);
+static bool _isImage(Disk *disk, const char *FILEPATH);
+
+static void _checkRange(Disk *disk, uint64_t offset, uint64_t size);
+static void _read(Disk *disk, uint64_t at, void *dest, size_t size);
+static void _readStream(Disk *disk, uint64_t at, void *dest, size_t size);
+static void _pread(Disk *disk, uint64_t at, char *dest, size_t size);
+static void _write(Disk *disk, const void *src, size_t size);
+
+static uint64_t _send(Disk *disk, int fd, uint64_t at, uint64_t size);
+static bool _sendCopy(Disk *disk, int fd, uint64_t at, uint64_t size);
+
+static bool _initDirty(Disk *disk);
+static void _markDirty(Disk *disk, uint64_t at, size_t size);
+static void _clearDirty(Disk *disk);
+static bool _isDirty(Disk *disk, uint64_t page);
+
+static void _saveCached(Disk *disk, const char *FILEPATH);
+
 Disk *diskOpen(const char *FILEPATH) {
 	Disk *disk = malloc(sizeof(*disk));
 	if( disk == NULL ) {
 		FATAL("couldn't allocate memory for disk");
 	}
 
-	if( !utilReadFile(FILEPATH, &disk->fp) ) {
+	disk->cache = NULL;
+	if( !_mapImage(disk, FILEPATH) ) {
 		free(disk);
 		return NULL;
 	}
@@ -31,104 +67,367 @@ Disk *diskOpen(const char *FILEPATH) {
 	return disk;
 }
 
-Disk *diskClone(Disk *disk) {
-	Disk *clone = malloc(sizeof(*clone));
-	if( clone == NULL ) {
+/* Maps the image at 'FILEPATH' into memory, copy-on-write
+ *
+ * Nothing is actually read here; the kernel pages blocks in as they're touched.
+ * Changes only make it to the image when it's saved
+ */
+static bool _mapImage(Disk *disk, const char *FILEPATH) {
+	disk->fd = open(FILEPATH, O_RDONLY);
+	if( disk->fd < 0 ) {
+		ERR("couldn't open the file at '%s'\n", FILEPATH);
+		return false;
+	}
+
+	struct stat st;
+	if( fstat(disk->fd, &st) < 0 || st.st_size == 0 ) {
+		ERR("couldn't get the size of the file at '%s'\n", FILEPATH);
+		close(disk->fd);
+		return false;
+	}
+
+	if( (uint64_t)st.st_size > SIZE_MAX ) {
+		ERR("'%s' is too big to map, open it with a block cache\n", FILEPATH);
+		close(disk->fd);
+		return false;
+	}
+
+	int share = MAP_PRIVATE;
+
+#ifdef MAP_NORESERVE
+	/* Only the pages that get written to need memory of their own, so don't
+	 * have the kernel set aside room for a private copy of the whole image
+	 * (which it may refuse to do for big ones)
+	 */
+	share |= MAP_NORESERVE;
+#endif
+
+	void *map =
+		mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, share, disk->fd, 0);
+	if( map == MAP_FAILED ) {
+		ERR("couldn't map the file at '%s'\n", FILEPATH);
+		close(disk->fd);
+		return false;
+	}
+
+	disk->map = map;
+	diskSetBlockSize(disk, DISK_DEFAULT_BLOCK_SIZE);
+	disk->pos = 0;
+	disk->size = st.st_size;
+
+	if( !_initDirty(disk) ) {
+		munmap(map, st.st_size);
+		close(disk->fd);
+		return false;
+	}
+
+	return true;
+}
+
+Disk *diskOpenCached(const char *FILEPATH, size_t budget) {
+	Disk *disk = malloc(sizeof(*disk));
+	if( disk == NULL ) {
 		FATAL("couldn't allocate memory for disk");
 	}
 
-	clone->filepath = disk->filepath;
-	utilCloneFile(&disk->fp, &clone->fp);
-	return clone;
+	disk->fd = open(FILEPATH, O_RDONLY);
+	if( disk->fd < 0 ) {
+		ERR("couldn't open the file at '%s'\n", FILEPATH);
+		free(disk);
+		return NULL;
+	}
+
+	struct stat st;
+	if( fstat(disk->fd, &st) < 0 || st.st_size == 0 ) {
+		ERR("couldn't get the size of the file at '%s'\n", FILEPATH);
+		close(disk->fd);
+		free(disk);
+		return NULL;
+	}
+
+	/* Changes are kept in the cache until saved */
+	disk->map = NULL;
+	disk->cache = cacheNew(disk->fd, st.st_size, CACHE_LINE_SIZE, budget);
+	diskSetBlockSize(disk, DISK_DEFAULT_BLOCK_SIZE);
+
+	disk->pos = 0;
+	disk->size = st.st_size;
+
+	if( !_initDirty(disk) ) {
+		cacheFree(disk->cache);
+		close(disk->fd);
+		free(disk);
+		return NULL;
+	}
+
+	disk->filepath = malloc(strlen(FILEPATH) + 1);
+	strcpy(disk->filepath, FILEPATH);
+
+	return disk;
+}
+
+/* Allocates the bitmap used to track which pages were written to */
+static bool _initDirty(Disk *disk) {
+	const uint64_t PAGES = (disk->size + DISK_PAGE_SIZE - 1) / DISK_PAGE_SIZE;
+
+	disk->dirty = calloc((PAGES + 7) / 8, 1);
+
+	if( disk->dirty == NULL ) {
+		ERR("couldn't allocate memory for dirty page bitmap\n");
+		return false;
+	}
+
+	return true;
 }
 
 void diskClose(Disk *disk) {
 	free(disk->filepath);
-	utilFreeFile(&disk->fp);
+	free(disk->dirty);
+
+	if( disk->cache != NULL ) {
+		cacheFree(disk->cache);
+	} else {
+		munmap(disk->map, disk->size);
+	}
+
+	close(disk->fd);
+
 	free(disk);
 }
 
-bool diskCheckBounds(Disk *disk, size_t size) {
-	const size_t END_POS = disk->fp.data - disk->fp._start + size;
-	return END_POS < disk->fp.size;
+bool diskCheckBounds(Disk *disk, uint64_t size) {
+	return size <= disk->size && disk->pos <= disk->size - size;
 }
 
 uint8_t diskRead8(Disk *disk) {
-	if( !diskCheckBounds(disk, 8) ) {
+	if( !diskCheckBounds(disk, 1) ) {
 		FATAL("tried to read past readable area\n");
 	}
 
-	return utilRead8(&disk->fp);
+	uint8_t data = diskRead8At(disk, disk->pos);
+	disk->pos += 1;
+
+	return data;
 }
 
 uint16_t diskRead16(Disk *disk) {
-	if( !diskCheckBounds(disk, 16) ) {
+	if( !diskCheckBounds(disk, 2) ) {
 		FATAL("tried to read past readable area\n");
 	}
 
-	return utilRead16(true, &disk->fp);
+	uint16_t data = diskRead16At(disk, disk->pos);
+	disk->pos += 2;
+
+	return data;
 }
 
 uint32_t diskRead32(Disk *disk) {
-	if( !diskCheckBounds(disk, 32) ) {
+	if( !diskCheckBounds(disk, 4) ) {
 		FATAL("tried to read past readable area\n");
 	}
 
-	return utilRead32(true, &disk->fp);
+	uint32_t data = diskRead32At(disk, disk->pos);
+	disk->pos += 4;
+
+	return data;
 }
 
 uint64_t diskRead64(Disk *disk) {
-	if( !diskCheckBounds(disk, 64) ) {
+	if( !diskCheckBounds(disk, 8) ) {
 		FATAL("tried to read past readable area\n");
 	}
 
-	return utilRead64(true, &disk->fp);
+	uint64_t data = diskRead64At(disk, disk->pos);
+	disk->pos += 8;
+
+	return data;
+}
+
+void diskReadAt(Disk *disk, uint64_t offset, void *dest, size_t size) {
+	_checkRange(disk, offset, size);
+	_read(disk, offset, dest, size);
+}
+
+void diskReadahead(Disk *disk, uint64_t offset, uint64_t size) {
+	if( offset >= disk->size ) {
+		return;
+	}
+
+	size = UTIL_MIN(size, disk->size - offset);
+
+	if( disk->map == NULL ) {
+		posix_fadvise(disk->fd, offset, size, POSIX_FADV_WILLNEED);
+		return;
+	}
+
+	/* madvise wants an address aligned to the system's page size */
+	const uint64_t PAGE = offset & ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+	posix_madvise(
+		disk->map + PAGE, (size_t)(size + (offset - PAGE)), POSIX_MADV_WILLNEED
+	);
+}
+
+uint8_t diskRead8At(Disk *disk, uint64_t offset) {
+	uint8_t data;
+	diskReadAt(disk, offset, &data, 1);
+
+	return data;
+}
+
+uint16_t diskRead16At(Disk *disk, uint64_t offset) {
+	uint8_t raw[2];
+	diskReadAt(disk, offset, raw, 2);
+
+	return utilLoad16(raw);
+}
+
+uint32_t diskRead32At(Disk *disk, uint64_t offset) {
+	uint8_t raw[4];
+	diskReadAt(disk, offset, raw, 4);
+
+	return utilLoad32(raw);
+}
+
+uint64_t diskRead64At(Disk *disk, uint64_t offset) {
+	uint8_t raw[8];
+	diskReadAt(disk, offset, raw, 8);
+
+	return utilLoad64(raw);
+}
+
+bool diskSendTo(Disk *disk, int fd, uint64_t offset, uint64_t size) {
+	_checkRange(disk, offset, size);
+
+	uint64_t at = offset;
+	const uint64_t END = at + size;
+
+	bool canSend = true;
+	while( at < END ) {
+		/* Find the run of pages that are all clean or all dirty */
+		const bool DIRTY = _isDirty(disk, at / DISK_PAGE_SIZE);
+
+		uint64_t runEnd = (at / DISK_PAGE_SIZE + 1) * DISK_PAGE_SIZE;
+		while( runEnd < END
+			   && _isDirty(disk, runEnd / DISK_PAGE_SIZE) == DIRTY ) {
+			runEnd += DISK_PAGE_SIZE;
+		}
+
+		const uint64_t RUN = UTIL_MIN(runEnd, END) - at;
+
+		uint64_t sent = 0;
+		if( !DIRTY && canSend ) {
+			sent = _send(disk, fd, at, RUN);
+			if( sent == RUN ) {
+				at += RUN;
+				continue;
+			}
+
+			if( errno != EINVAL && errno != ENOSYS ) {
+				return false;
+			}
+
+			/* The descriptor doesn't support it; don't try again */
+			canSend = false;
+		}
+
+		if( !_sendCopy(disk, fd, at + sent, RUN - sent) ) {
+			return false;
+		}
+
+		at += RUN;
+	}
+
+	return true;
+}
+
+void diskSetBlockSize(Disk *disk, size_t blockSize) {
+	if( blockSize == 0 || (blockSize & (blockSize - 1)) != 0 ) {
+		FATAL("block size %zu is not a power of two\n", blockSize);
+	}
+
+	disk->blockSize = blockSize;
+	disk->blockShift = 0;
+	while( ((size_t)1 << disk->blockShift) < blockSize ) {
+		++disk->blockShift;
+	}
+}
+
+DiskBlock diskGetBlock(Disk *disk, uint64_t blockno) {
+	const uint64_t AT = diskBlockOffset(disk, blockno);
+	_checkRange(disk, AT, disk->blockSize);
+
+	DiskBlock block = { NULL, disk->blockSize, NULL, NULL };
+
+	if( disk->map != NULL ) {
+		block.data = disk->map + AT;
+		return block;
+	}
+
+	const size_t LINE_SIZE = disk->cache->lineSize;
+	if( AT % LINE_SIZE + disk->blockSize <= LINE_SIZE ) {
+		/* Fits in a single line, so just hold on to it */
+		block._line = cacheAcquire(disk->cache, AT / LINE_SIZE);
+		block.data = block._line->data + AT % LINE_SIZE;
+		return block;
+	}
+
+	block._copy = malloc(disk->blockSize);
+	if( block._copy == NULL ) {
+		FATAL("couldn't allocate memory for block\n");
+	}
+
+	_read(disk, AT, block._copy, disk->blockSize);
+	block.data = block._copy;
+
+	return block;
+}
+
+void diskReleaseBlock(Disk *disk, DiskBlock *block) {
+	if( block->_line != NULL ) {
+		cacheRelease(disk->cache, block->_line);
+	}
+
+	free(block->_copy);
+
+	block->data = NULL;
+	block->_line = NULL;
+	block->_copy = NULL;
 }
 
 void diskWrite8(Disk *disk, uint8_t data) {
-	*disk->fp.data = data;
-	++disk->fp.data;
+	diskWriteBuf(disk, &data, 1);
 }
 
+/* Values are encoded little-endian first, so each one is a single write */
 void diskWrite16(Disk *disk, uint16_t data) {
-	diskWrite8(disk, UTIL_SHFR(data, 0));
-	diskWrite8(disk, UTIL_SHFR(data, 8));
+	const uint16_t LE = htole16(data);
+	diskWriteBuf(disk, &LE, sizeof(LE));
 }
 
 void diskWrite32(Disk *disk, uint32_t data) {
-	diskWrite8(disk, UTIL_SHFR(data, 0));
-	diskWrite8(disk, UTIL_SHFR(data, 8));
-	diskWrite8(disk, UTIL_SHFR(data, 16));
-	diskWrite8(disk, UTIL_SHFR(data, 24));
+	const uint32_t LE = htole32(data);
+	diskWriteBuf(disk, &LE, sizeof(LE));
 }
 
 void diskWrite64(Disk *disk, uint64_t data) {
-	diskWrite8(disk, UTIL_SHFR(data, 0));
-	diskWrite8(disk, UTIL_SHFR(data, 8));
-	diskWrite8(disk, UTIL_SHFR(data, 16));
-	diskWrite8(disk, UTIL_SHFR(data, 24));
-	diskWrite8(disk, UTIL_SHFR(data, 32));
-	diskWrite8(disk, UTIL_SHFR(data, 40));
-	diskWrite8(disk, UTIL_SHFR(data, 48));
-	diskWrite8(disk, UTIL_SHFR(data, 56));
-}
-
-FILE *diskOpenAsFile(Disk *disk, long startPos) {
-	FILE *file = fopen(disk->filepath, "r+b");
-	if( file == NULL ) {
-		FATAL("couldn't reopen disk file\n");
+	const uint64_t LE = htole64(data);
+	diskWriteBuf(disk, &LE, sizeof(LE));
+}
+
+void diskWriteBuf(Disk *disk, const void *src, size_t size) {
+	if( !diskCheckBounds(disk, size) ) {
+		FATAL("tried to write past writable area\n");
 	}
 
-	fseek(file, startPos, SEEK_SET);
-	return file;
+	_write(disk, src, size);
 }
 
-void diskSkip(Disk *disk, size_t skip) {
+void diskSkip(Disk *disk, uint64_t skip) {
 	if( !diskCheckBounds(disk, skip) ) {
 		FATAL("tried to read past readable area\n");
 	}
 
-	disk->fp.data += skip;
+	disk->pos += skip;
 }
 
 void diskCopy(Disk *disk, void *dest, size_t size) {
@@ -136,41 +435,363 @@ void diskCopy(Disk *disk, void *dest, size_t size) {
 		FATAL("tried to read past readable area\n");
 	}
 
-	memcpy(dest, disk->fp.data, size);
-	diskSkip(disk, size);
+	_read(disk, disk->pos, dest, size);
+	disk->pos += size;
+}
+
+void diskSeek(Disk *disk, uint64_t pos) {
+	disk->pos = 0;
+	diskSkip(disk, pos);
+}
+
+void diskSeekStart(Disk *disk) {
+	disk->pos = 0;
+}
+
+uint64_t diskGetPos(Disk *disk) {
+	return disk->pos;
 }
 
-void diskRewind(Disk *disk, size_t pos) {
-	if( (disk->fp.data - pos) < disk->fp._start ) {
-		FATAL("tried to rewind to before start of file\n");
+bool diskGetCacheStats(Disk *disk, CacheStats *stats) {
+	if( disk->cache == NULL ) {
+		return false;
 	}
 
-	disk->fp.data -= pos;
+	cacheGetStats(disk->cache, stats);
+	return true;
 }
 
-void diskSeek(Disk *disk, size_t pos) {
-	disk->fp.data = disk->fp._start;
-	diskSkip(disk, pos);
+static void _checkRange(Disk *disk, uint64_t offset, uint64_t size) {
+	if( offset > disk->size || size > disk->size - offset ) {
+		FATAL("tried to access past the end of the disk\n");
+	}
 }
 
-void diskSeekStart(Disk *disk) {
-	disk->fp.data = disk->fp._start;
+/* Reads 'size' bytes at offset 'at' into the image */
+static void _read(Disk *disk, uint64_t at, void *dest, size_t size) {
+	if( disk->map != NULL ) {
+		memcpy(dest, disk->map + at, size);
+		return;
+	}
+
+	if( size >= DISK_STREAM_SIZE ) {
+		_readStream(disk, at, dest, size);
+		return;
+	}
+
+	char *out = dest;
+	const size_t LINE_SIZE = disk->cache->lineSize;
+
+	while( size > 0 ) {
+		const size_t OFFSET = at % LINE_SIZE;
+		const size_t CHUNK = UTIL_MIN(size, LINE_SIZE - OFFSET);
+
+		CacheLine *line = cacheAcquire(disk->cache, at / LINE_SIZE);
+		memcpy(out, line->data + OFFSET, CHUNK);
+		cacheRelease(disk->cache, line);
+
+		out += CHUNK;
+		at += CHUNK;
+		size -= CHUNK;
+	}
 }
 
-size_t diskGetPos(Disk *disk) {
-	return disk->fp.data - disk->fp._start;
+/* Reads a large range without pulling it into the cache
+ *
+ * Cached lines have to be used, since they may hold changes that haven't been
+ * saved yet; everything in between is read straight from the image
+ */
+static void _readStream(Disk *disk, uint64_t at, void *dest, size_t size) {
+	char *out = dest;
+	const size_t LINE_SIZE = disk->cache->lineSize;
+
+	size_t gap = 0;
+	while( size > 0 ) {
+		const size_t OFFSET = at % LINE_SIZE;
+		const size_t CHUNK = UTIL_MIN(size, LINE_SIZE - OFFSET);
+
+		CacheLine *line = cacheAcquireCached(disk->cache, at / LINE_SIZE);
+		if( line == NULL ) {
+			gap += CHUNK;
+		} else {
+			_pread(disk, at - gap, out - gap, gap);
+			gap = 0;
+
+			memcpy(out, line->data + OFFSET, CHUNK);
+			cacheRelease(disk->cache, line);
+		}
+
+		out += CHUNK;
+		at += CHUNK;
+		size -= CHUNK;
+	}
+
+	_pread(disk, at - gap, out - gap, gap);
+}
+
+static void _pread(Disk *disk, uint64_t at, char *dest, size_t size) {
+	while( size > 0 ) {
+		const ssize_t READ = pread(disk->fd, dest, size, at);
+		if( READ <= 0 ) {
+			FATAL("couldn't read from image\n");
+		}
+
+		dest += READ;
+		at += READ;
+		size -= READ;
+	}
+}
+
+/* Writes 'size' bytes at the cursor and advances it */
+static void _write(Disk *disk, const void *src, size_t size) {
+	uint64_t at = disk->pos;
+	disk->pos += size;
+
+	_markDirty(disk, at, size);
+
+	if( disk->map != NULL ) {
+		memcpy(disk->map + at, src, size);
+		return;
+	}
+
+	const char *in = src;
+	const size_t LINE_SIZE = disk->cache->lineSize;
+
+	while( size > 0 ) {
+		const size_t OFFSET = at % LINE_SIZE;
+		const size_t CHUNK = UTIL_MIN(size, LINE_SIZE - OFFSET);
+
+		CacheLine *line = cacheAcquire(disk->cache, at / LINE_SIZE);
+		memcpy(line->data + OFFSET, in, CHUNK);
+		cacheMarkDirty(disk->cache, line);
+		cacheRelease(disk->cache, line);
+
+		in += CHUNK;
+		at += CHUNK;
+		size -= CHUNK;
+	}
+}
+
+/* Has the kernel copy a range of the image to 'fd'
+ * Returns how many bytes were copied, with errno set if that's short
+ */
+static uint64_t _send(Disk *disk, int fd, uint64_t at, uint64_t size) {
+#ifdef __linux__
+	off_t offset = at;
+	while( size > 0 ) {
+		const size_t CHUNK = UTIL_MIN(size, DISK_SEND_SIZE);
+		const ssize_t SENT = sendfile(fd, disk->fd, &offset, CHUNK);
+		if( SENT < 0 && errno == EINTR ) {
+			continue;
+		}
+
+		if( SENT <= 0 ) {
+			if( SENT == 0 ) {
+				errno = EIO;
+			}
+
+			break;
+		}
+
+		size -= SENT;
+	}
+
+	return (uint64_t)offset - at;
+#else
+	UNUSED(disk);
+	UNUSED(fd);
+	UNUSED(at);
+	UNUSED(size);
+
+	errno = ENOSYS;
+	return 0;
+#endif
+}
+
+/* Writes a range of the image to 'fd' from memory
+ *
+ * Mapped images are written in one go; cached ones are streamed through a
+ * scratch buffer so that unsaved changes are picked up
+ */
+static bool _sendCopy(Disk *disk, int fd, uint64_t at, uint64_t size) {
+	if( disk->map != NULL ) {
+		return utilWriteAll(fd, disk->map + at, (size_t)size);
+	}
+
+	const size_t SCRATCH_SIZE = UTIL_MIN(size, DISK_STREAM_SIZE * 16);
+
+	char *scratch = malloc(SCRATCH_SIZE);
+	if( scratch == NULL ) {
+		FATAL("couldn't allocate memory for send buffer\n");
+	}
+
+	bool ok = true;
+	while( ok && size > 0 ) {
+		const size_t CHUNK = UTIL_MIN(size, SCRATCH_SIZE);
+		_read(disk, at, scratch, CHUNK);
+		ok = utilWriteAll(fd, scratch, CHUNK);
+
+		at += CHUNK;
+		size -= CHUNK;
+	}
+
+	free(scratch);
+	return ok;
 }
 
 void diskSave(Disk *disk, const char *FILEPATH) {
-	size_t pos = diskGetPos(disk);
-	diskSeekStart(disk);
+	if( _isImage(disk, FILEPATH) ) {
+		/* Everything else in the image is already what we'd write */
+		diskSaveDirty(disk, FILEPATH);
+		return;
+	}
+
+	if( disk->cache != NULL ) {
+		_saveCached(disk, FILEPATH);
+		return;
+	}
+
+	FILE *file = fopen(FILEPATH, "wb");
+	if( file == NULL ) {
+		FATAL("couldn't open file");
+	}
+
+	if( fwrite(disk->map, 1, disk->size, file) < disk->size ) {
+		FATAL("couldn't write the image to '%s'\n", FILEPATH);
+	}
+
+	fclose(file);
+}
+
+/* Saves a cache-backed disk to a new file
+ *
+ * The image is streamed through a scratch buffer, so the cache isn't flooded
+ * with blocks that are only needed once
+ */
+static void _saveCached(Disk *disk, const char *FILEPATH) {
+	Cache *cache = disk->cache;
 
 	FILE *file = fopen(FILEPATH, "wb");
 	if( file == NULL ) {
 		FATAL("couldn't open file");
 	}
 
-	fwrite(disk->fp.data, 1, disk->fp.size, file);
+	char *scratch = malloc(cache->lineSize);
+	if( scratch == NULL ) {
+		FATAL("couldn't allocate memory for save buffer\n");
+	}
+
+	const uint64_t LINES = (disk->size + cache->lineSize - 1) / cache->lineSize;
+	for( uint64_t i = 0; i < LINES; ++i ) {
+		const uint64_t START = i * cache->lineSize;
+		const size_t SIZE = UTIL_MIN(cache->lineSize, disk->size - START);
+
+		const char *data = scratch;
+
+		CacheLine *line = cachePeek(cache, i);
+		if( line != NULL ) {
+			data = line->data;
+		} else if( pread(disk->fd, scratch, SIZE, START) < (ssize_t)SIZE ) {
+			FATAL("couldn't read block %" PRIu64 " from image\n", i);
+		}
+
+		if( fwrite(data, 1, SIZE, file) < SIZE ) {
+			FATAL("couldn't write the image to '%s'\n", FILEPATH);
+		}
+	}
+
+	free(scratch);
+	fclose(file);
+}
+
+bool diskSaveDirty(Disk *disk, const char *FILEPATH) {
+	if( FILEPATH == NULL ) {
+		FILEPATH = disk->filepath;
+	}
+
+	const bool IN_PLACE = _isImage(disk, FILEPATH);
+
+	const int FD = open(FILEPATH, O_WRONLY);
+	if( FD < 0 ) {
+		ERR("couldn't open the file at '%s'\n", FILEPATH);
+		return false;
+	}
+
+	struct stat st;
+	if( fstat(FD, &st) < 0 || (uint64_t)st.st_size != disk->size ) {
+		ERR("'%s' isn't a copy of the image (sizes differ)\n", FILEPATH);
+		close(FD);
+		return false;
+	}
+
+	const uint64_t PAGES = (disk->size + DISK_PAGE_SIZE - 1) / DISK_PAGE_SIZE;
+	for( uint64_t i = 0; i < PAGES; ++i ) {
+		if( (disk->dirty[i >> 3] & (1 << (i & 7))) == 0 ) {
+			continue;
+		}
+
+		const uint64_t START = i * DISK_PAGE_SIZE;
+		const size_t SIZE = UTIL_MIN(DISK_PAGE_SIZE, disk->size - START);
+
+		const char *data;
+		if( disk->map != NULL ) {
+			data = disk->map + START;
+		} else {
+			/* Dirty lines are never evicted, so this can't miss */
+			data = cachePeek(disk->cache, i)->data;
+		}
+
+		if( pwrite(FD, data, SIZE, START) < (ssize_t)SIZE ) {
+			ERR("couldn't write block %" PRIu64 " to '%s'\n", i, FILEPATH);
+			close(FD);
+			return false;
+		}
+	}
+
+	close(FD);
+
+	/* Copies can be updated again later, so only forget about changes once
+	 * they've made it to the image itself
+	 */
+	if( IN_PLACE ) {
+		_clearDirty(disk);
+	}
+
+	return true;
+}
+
+static void _markDirty(Disk *disk, uint64_t at, size_t size) {
+	if( size == 0 ) {
+		return;
+	}
+
+	const uint64_t FIRST = at / DISK_PAGE_SIZE;
+	const uint64_t LAST = (at + size - 1) / DISK_PAGE_SIZE;
+
+	for( uint64_t i = FIRST; i <= LAST; ++i ) {
+		disk->dirty[i >> 3] |= 1 << (i & 7);
+	}
+}
+
+static void _clearDirty(Disk *disk) {
+	const uint64_t PAGES = (disk->size + DISK_PAGE_SIZE - 1) / DISK_PAGE_SIZE;
+	memset(disk->dirty, 0, (PAGES + 7) / 8);
+
+	if( disk->cache != NULL ) {
+		cacheMarkClean(disk->cache);
+	}
+}
+
+static bool _isDirty(Disk *disk, uint64_t page) {
+	return (disk->dirty[page >> 3] & (1 << (page & 7))) != 0;
+}
+
+/* Checks if 'FILEPATH' refers to the file backing this disk */
+static bool _isImage(Disk *disk, const char *FILEPATH) {
+	struct stat image, other;
+	if( fstat(disk->fd, &image) < 0 || stat(FILEPATH, &other) < 0 ) {
+		return false;
+	}
 
-	diskSeek(disk, pos);
+	return image.st_dev == other.st_dev && image.st_ino == other.st_ino;
 }
@@ -3,45 +3,115 @@
  */
 
 #include <inttypes.h>
-#include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "balloc.h"
 #include "bg.h"
+#include "blockmap.h"
+#include "dcache.h"
 #include "dir.h"
 #include "disk.h"
+#include "icache.h"
+#include "fault.h"
+#include "inode.h"
 #include "superblock.h"
 #include "util.h"
 
 #include "ext2.h"
 
+/* What '_releaseChild' needs while a directory is being deleted */
+typedef struct _Ext2Release {
+	Ext2 *ext2;
+	BGFrees *frees; /* One per group */
+} Ext2Release;
+
+/* Blocks taken for a file being extended, and how many more it needs */
+typedef struct _Ext2Run {
+	uint32_t goal; /* Last block handed out; the next ones follow it */
+	uint32_t left; /* Blocks taken after 'goal' and not mapped yet */
+	uint32_t want; /* Data blocks the file still needs */
+} Ext2Run;
+
+static Ext2 *_open(Disk *disk);
 static uint32_t _inodeToBG(Ext2 *ext2, uint32_t inodenum);
+static uint8_t _filetypeOf(Ext2 *ext2, uint32_t inodenum);
+static bool _findEntry(
+	Ext2 *ext2, uint32_t parent, const char *NAME, DirList *list, Dir **entry
+);
+
+static uint32_t _blockToBG(Ext2 *ext2, uint32_t blockno);
+static BGFrees *_newFrees(Ext2 *ext2);
+static void _release(
+	Ext2 *ext2, uint32_t inodenum, bool isDir, BGFrees *frees
+);
+static bool _releaseChild(Dir *dir, void *ctx);
+static void _releaseBlocks(Ext2 *ext2, const Inode *inode, BGFrees *frees);
+static void _releaseIndirect(
+	Ext2 *ext2, uint32_t blockno, int level, BGFrees *frees
+);
+static void _releaseBlock(Ext2 *ext2, uint32_t blockno, BGFrees *frees);
+static void _releaseXattr(Ext2 *ext2, uint32_t blockno, BGFrees *frees);
+static void _commitFrees(Ext2 *ext2, BGFrees *frees);
+static bool _mapBlock(
+	Ext2 *ext2, uint32_t inodenum, Inode *inode, uint64_t index, Ext2Run *run,
+	const char *ZERO
+);
+static bool _newBlock(
+	Ext2 *ext2, uint32_t inodenum, Inode *inode, Ext2Run *run,
+	const char *ZERO, uint32_t *blockno
+);
 
 Ext2 *ext2Open(const char *FILEPATH) {
-	Ext2 *ext2 = malloc(sizeof(*ext2));
+	Disk *disk = diskOpen(FILEPATH);
+	if( disk == NULL ) {
+		return NULL;
+	}
+
+	return _open(disk);
+}
 
-	ext2->disk = diskOpen(FILEPATH);
-	if( ext2->disk == NULL ) {
+Ext2 *ext2OpenCached(const char *FILEPATH, size_t cacheSize) {
+	Disk *disk = diskOpenCached(FILEPATH, cacheSize);
+	if( disk == NULL ) {
 		return NULL;
 	}
 
-	/* Skip group 0 */
-	diskSkip(ext2->disk, 1024);
+	return _open(disk);
+}
 
-	/* Read first block group */
-	ext2->bgs = malloc(sizeof(*ext2->bgs));
-	if( !bgRead(0, ext2->bgs, ext2->disk) ) {
+static Ext2 *_open(Disk *disk) {
+	Superblock sb;
+	if( !sbRead(&sb, disk) ) {
+		diskClose(disk);
 		return NULL;
 	}
 
-	Superblock *sb = &ext2->bgs->sb;
+	Ext2 *ext2 = malloc(sizeof(*ext2));
+	ext2->disk = disk;
+	ext2->icache = icacheNew(disk, ICACHE_DEFAULT_BUDGET);
+	ext2->dcache = dcacheNew(DCACHE_DEFAULT_BUDGET);
+
+	/* Groups start at the first data block, and the last one may be short */
+	const uint32_t BLOCKS = sb.blockCount - sb.firstDataBlock;
+	ext2->bgCount = (BLOCKS + sb.blocksPerGroup - 1) / sb.blocksPerGroup;
+
+	ext2->bgs = calloc(ext2->bgCount, sizeof(*ext2->bgs));
+	if( ext2->bgs == NULL ) {
+		FATAL("couldn't allocate memory for block groups\n");
+	}
 
-	const double BG_COUNT = (double)sb->blockCount / (double)sb->blocksPerGroup;
-	ext2->bgCount = (size_t)ceil(BG_COUNT);
-	ext2->bgs = realloc(ext2->bgs, ext2->bgCount * sizeof(*ext2->bgs));
+	ext2->balloc = ballocNew(disk, ext2->bgs, ext2->bgCount);
+
+	if( !bgReadAll(ext2->bgs, ext2->bgCount, disk, ext2->icache) ) {
+		ext2Free(ext2);
+		return NULL;
+	}
 
 	return ext2;
 }
@@ -49,10 +119,17 @@ Ext2 *ext2Open(const char *FILEPATH) {
 void ext2Free(Ext2 *ext2) {
 	diskClose(ext2->disk);
 	bgFreeAll(ext2->bgs, ext2->bgCount);
+	icacheFree(ext2->icache);
+	dcacheFree(ext2->dcache);
+	ballocFree(ext2->balloc);
 
 	free(ext2);
 }
 
+void ext2SetInodeCacheSize(Ext2 *ext2, size_t size) {
+	icacheSetBudget(ext2->icache, size);
+}
+
 void ext2GetInode(Ext2 *ext2, uint32_t inodenum, Inode *inode) {
 	uint32_t bg = _inodeToBG(ext2, inodenum);
 	bgGetInode(&ext2->bgs[bg], inodenum, inode);
@@ -63,45 +140,311 @@ uint64_t ext2GetInodeSize(Ext2 *ext2, uint32_t inodenum, Inode *inode) {
 	return bgGetInodeSize(&ext2->bgs[bg], inode);
 }
 
-bool ext2GetDir(Ext2 *ext2, uint32_t inodenum, Dir *dir) {
+uint64_t ext2GetDataBlocks(Ext2 *ext2, uint32_t inodenum, Inode *inode) {
+	uint32_t bg = _inodeToBG(ext2, inodenum);
+	return bgGetDataBlocks(&ext2->bgs[bg], inode);
+}
+
+bool ext2GetDir(Ext2 *ext2, uint32_t inodenum, DirList *list) {
 	uint32_t bg = _inodeToBG(ext2, inodenum);
-	return bgGetDir(&ext2->bgs[bg], inodenum, dir);
+	return bgGetDir(&ext2->bgs[bg], inodenum, list);
 }
 
-bool ext2ReadFile(Ext2 *ext2, uint32_t inodenum, FP *fp) {
+bool ext2DirIterate(
+	Ext2 *ext2, uint32_t inodenum, DirVisitor visit, void *ctx
+) {
 	uint32_t bg = _inodeToBG(ext2, inodenum);
-	return bgReadFile(&ext2->bgs[bg], inodenum, fp);
+	return bgDirIterate(&ext2->bgs[bg], inodenum, visit, ctx);
+}
+
+bool ext2FindInode(
+	Ext2 *ext2, uint32_t parent, const char *NAME, uint32_t *inode,
+	uint8_t *filetype
+) {
+	if( !dcacheLookup(ext2->dcache, parent, NAME, inode, filetype) ) {
+		DirList list;
+		Dir *entry;
+		if( _findEntry(ext2, parent, NAME, &list, &entry) ) {
+			*inode = entry->inode;
+			*filetype = entry->filetype;
+		} else {
+			*inode = 0;
+		}
+
+		dirListFree(&list);
+	}
+
+	return *inode != 0;
+}
+
+bool ext2Lookup(
+	Ext2 *ext2, uint32_t cwd, const char *PATH, uint32_t *inode,
+	uint8_t *filetype
+) {
+	uint32_t at = (PATH[0] == '/') ? INODE_RES_ROOT_DIR : cwd;
+	uint8_t type = DIR_FT_DIR;
+
+	char name[DIR_NAME_MAX + 1];
+
+	const char *component = PATH;
+	while( true ) {
+		component += strspn(component, "/");
+		if( *component == '\0' ) {
+			break;
+		}
+
+		const size_t LEN = strcspn(component, "/");
+
+		/* Only directories have anything under them */
+		if( type != DIR_FT_DIR || LEN > DIR_NAME_MAX ) {
+			return false;
+		}
+
+		memcpy(name, component, LEN);
+		name[LEN] = '\0';
+		component += LEN;
+
+		if( strcmp(name, ".") == 0 ) {
+			continue;
+		}
+
+		if( !ext2FindInode(ext2, at, name, &at, &type) ) {
+			return false;
+		}
+
+		/* Entries only record their type with the filetype feature */
+		if( type == DIR_FT_UNKNOWN ) {
+			type = _filetypeOf(ext2, at);
+		}
+	}
+
+	*inode = at;
+	*filetype = type;
+
+	return true;
+}
+
+uint8_t ext2GetFiletype(Ext2 *ext2, const Dir *dir) {
+	if( dir->filetype != DIR_FT_UNKNOWN ) {
+		return dir->filetype;
+	}
+
+	return _filetypeOf(ext2, dir->inode);
+}
+
+bool ext2FindEntry(
+	Ext2 *ext2, uint32_t inodenum, const char *NAME, DirList *list,
+	Dir **entry
+) {
+	uint32_t inode;
+	uint8_t filetype;
+
+	/* Only a name known to be missing saves the scan, since the caller wants
+	 * the entry's block as well
+	 */
+	if( dcacheLookup(ext2->dcache, inodenum, NAME, &inode, &filetype)
+		&& inode == 0 ) {
+		dirListInit(list);
+		*entry = NULL;
+		return false;
+	}
+
+	return _findEntry(ext2, inodenum, NAME, list, entry);
+}
+
+bool ext2CheckCounts(Ext2 *ext2) {
+	bool ok = true;
+	uint64_t freeBlocks = 0, freeInodes = 0;
+
+	for( size_t i = 0; i < ext2->bgCount; ++i ) {
+		BlockGroup *bg = &ext2->bgs[i];
+
+		uint32_t blocks, inodes;
+		bgCountFree(bg, &blocks, &inodes);
+
+		freeBlocks += blocks;
+		freeInodes += inodes;
+
+		if( bg->desc.freeBlocks != blocks ) {
+			WARN(
+				"group %zu: descriptor has %" PRIu16 " free blocks, bitmap has "
+				"%" PRIu32 "\n",
+				i, bg->desc.freeBlocks, blocks
+			);
+			ok = false;
+		}
+
+		if( bg->desc.freeInodes != inodes ) {
+			WARN(
+				"group %zu: descriptor has %" PRIu16 " free inodes, bitmap has "
+				"%" PRIu32 "\n",
+				i, bg->desc.freeInodes, inodes
+			);
+			ok = false;
+		}
+	}
+
+	const Superblock *SB = &ext2->bgs->sb;
+	if( SB->freeBlocksCount != freeBlocks ) {
+		WARN(
+			"Superblock has %" PRIu32 " free blocks, bitmaps have %" PRIu64
+			"\n",
+			SB->freeBlocksCount, freeBlocks
+		);
+		ok = false;
+	}
+
+	if( SB->freeInodesCount != freeInodes ) {
+		WARN(
+			"Superblock has %" PRIu32 " free inodes, bitmaps have %" PRIu64
+			"\n",
+			SB->freeInodesCount, freeInodes
+		);
+		ok = false;
+	}
+
+	return ok;
+}
+
+uint32_t ext2AllocBlock(Ext2 *ext2, uint32_t inodenum, uint32_t goal) {
+	Inode inode;
+	ext2GetInode(ext2, inodenum, &inode);
+
+	const bool IS_DIR = (inode.mode & INODE_FM_TYPE) == INODE_FM_DIR;
+	return ballocAlloc(ext2->balloc, inodenum, IS_DIR, goal);
+}
+
+void ext2CloseFile(Ext2 *ext2, uint32_t inodenum) {
+	ballocDiscard(ext2->balloc, inodenum);
+	ballocCommit(ext2->balloc);
 }
 
-bool ext2DeleteFile(Ext2 *ext2, Dir *root, Dir *file) {
-	if( file->filetype != DIR_FT_FILE ) {
+bool ext2ExtendFile(Ext2 *ext2, uint32_t inodenum, uint32_t count) {
+	const Superblock *SB = &ext2->bgs->sb;
+	const uint32_t BLOCK_SIZE = (uint32_t)ext2->disk->blockSize;
+
+	Inode inode;
+	ext2GetInode(ext2, inodenum, &inode);
+
+	if( (inode.mode & INODE_FM_TYPE) != INODE_FM_FILE ) {
+		ERR("inode %" PRIu32 " is not a regular file\n", inodenum);
 		return false;
 	}
 
-	uint32_t bg = _inodeToBG(ext2, file->inode);
-	bgDeleteFile(&ext2->bgs[bg], root, file);
+	/* New blocks go after the last one, even if the file ends in a hole */
+	const uint64_t FIRST =
+		(ext2GetInodeSize(ext2, inodenum, &inode) + BLOCK_SIZE - 1)
+		/ BLOCK_SIZE;
+
+	/* Without the large file feature, sizes have to fit in 31 bits */
+	const bool LARGE = SB->revLevel == SB_REV_DYNAMIC
+		&& (SB->featuresReadOnly & SB_FRO_LARGE_FILE);
+	if( !LARGE && (FIRST + count) * BLOCK_SIZE > INT32_MAX ) {
+		ERR("file would be too large without the large file feature\n");
+		return false;
+	}
+
+	/* Carrying on from the file's last block keeps the new ones after it */
+	Ext2Run run = { .goal = 0, .left = 0, .want = 0 };
+	if( FIRST > 0 ) {
+		BlockMap map;
+		blockmapInit(&map, ext2->disk, BLOCK_SIZE, &inode);
+		run.goal = blockmapGet(&map, FIRST - 1);
+		blockmapFree(&map);
+	}
+
+	char *zero = calloc(1, BLOCK_SIZE);
+	if( zero == NULL ) {
+		FATAL("couldn't allocate memory for a block\n");
+	}
+
+	const uint32_t BLOCKS = inode.blocks;
+	uint32_t added = 0;
+	while( added < count ) {
+		run.want = count - added;
+		if( !_mapBlock(ext2, inodenum, &inode, FIRST + added, &run, zero) ) {
+			break;
+		}
+
+		++added;
+	}
+
+	free(zero);
+
+	/* Blocks taken but never mapped, if the file ran out of room, go back */
+	if( run.left > 0 ) {
+		BGFrees *frees = _newFrees(ext2);
+		for( uint32_t i = 1; i <= run.left; ++i ) {
+			_releaseBlock(ext2, run.goal + i, frees);
+		}
+
+		_commitFrees(ext2, frees);
+		free(frees);
+	}
+
+	if( added > 0 ) {
+		const uint64_t SIZE = (FIRST + added) * BLOCK_SIZE;
+		inode.size_lo = (uint32_t)SIZE;
+		inode.size_hi = (uint32_t)(SIZE >> 32);
+		inode.modifyTime = time(NULL);
+	}
+
+	/* An indirect block mapped just before the disk filled up belongs to the
+	 * file even though no data block made it in after it
+	 */
+	if( inode.blocks != BLOCKS ) {
+		bgSetInode(&ext2->bgs[_inodeToBG(ext2, inodenum)], inodenum, &inode);
+	}
+
+	ext2CloseFile(ext2, inodenum);
+
+	if( added < count ) {
+		ERR("only %" PRIu32 " of %" PRIu32 " blocks fit\n", added, count);
+		return false;
+	}
 
 	return true;
 }
 
-/* battle plan:
- * - loop over children;
- *   - is dir?
- *     - recursively call this function;
- *     - CONTINUE;
- *   - is file?
- *     - call ext2DeleteFile;
- *     - CONTINUE;
- * - delete inode;
- * - change inode bitmap + block bitmap;
- * - update directory entry;
- * - END.
- */
-bool ext2DeleteDir(Ext2 *ext2, Dir *root, Dir *dir) {
-	if( dir->filetype != DIR_FT_DIR ) {
+bool ext2DeleteFile(Ext2 *ext2, uint32_t parent, Dir *file) {
+	if( ext2GetFiletype(ext2, file) != DIR_FT_FILE ) {
 		return false;
 	}
 
+	BGFrees *frees = _newFrees(ext2);
+
+	bgUnlink(&ext2->bgs[_inodeToBG(ext2, parent)], parent, file, false);
+	_release(ext2, file->inode, false, frees);
+	_commitFrees(ext2, frees);
+
+	free(frees);
+
+	/* The name is gone now, which is worth remembering too */
+	dcacheInsert(ext2->dcache, parent, file->filename, 0, DIR_FT_UNKNOWN);
+
+	return true;
+}
+
+bool ext2DeleteDir(Ext2 *ext2, uint32_t parent, Dir *dir) {
+	if( ext2GetFiletype(ext2, dir) != DIR_FT_DIR ) {
+		return false;
+	}
+
+	if( strcmp(dir->filename, ".") == 0 || strcmp(dir->filename, "..") == 0 ) {
+		ERR("refusing to remove '%s'\n", dir->filename);
+		return false;
+	}
+
+	BGFrees *frees = _newFrees(ext2);
+
+	bgUnlink(&ext2->bgs[_inodeToBG(ext2, parent)], parent, dir, true);
+	_release(ext2, dir->inode, true, frees);
+	_commitFrees(ext2, frees);
+
+	free(frees);
+
+	dcacheInsert(ext2->dcache, parent, dir->filename, 0, DIR_FT_UNKNOWN);
+
 	return true;
 }
 
@@ -109,6 +452,320 @@ static uint32_t _inodeToBG(Ext2 *ext2, uint32_t inodenum) {
 	return (inodenum - 1) / ext2->bgs->sb.inodesPerGroup;
 }
 
+/* Works out the DIR_FT_* type of an inode from its mode */
+static uint8_t _filetypeOf(Ext2 *ext2, uint32_t inodenum) {
+	Inode inode;
+	ext2GetInode(ext2, inodenum, &inode);
+
+	switch( inode.mode & INODE_FM_TYPE ) {
+	case INODE_FM_FILE:
+		return DIR_FT_FILE;
+	case INODE_FM_DIR:
+		return DIR_FT_DIR;
+	case INODE_FM_CHAR:
+		return DIR_FT_CHAR_DEV;
+	case INODE_FM_BLOCK:
+		return DIR_FT_BLOCK_DEV;
+	case INODE_FM_FIFO:
+		return DIR_FT_FIFO;
+	case INODE_FM_SOCK:
+		return DIR_FT_SOCKET;
+	case INODE_FM_SYMB:
+		return DIR_FT_SYMLINK;
+	}
+
+	return DIR_FT_UNKNOWN;
+}
+
+/* Looks 'NAME' up in the directory itself, and caches what was found */
+static bool _findEntry(
+	Ext2 *ext2, uint32_t parent, const char *NAME, DirList *list, Dir **entry
+) {
+	uint32_t bg = _inodeToBG(ext2, parent);
+	if( !bgFindEntry(&ext2->bgs[bg], parent, NAME, list, entry) ) {
+		dcacheInsert(ext2->dcache, parent, NAME, 0, DIR_FT_UNKNOWN);
+		return false;
+	}
+
+	dcacheInsert(
+		ext2->dcache, parent, NAME, (*entry)->inode, (*entry)->filetype
+	);
+
+	return true;
+}
+
 void ext2SaveToFile(Ext2 *ext2, const char *FILEPATH) {
 	diskSave(ext2->disk, FILEPATH);
 }
+
+bool ext2SaveDirty(Ext2 *ext2, const char *FILEPATH) {
+	return diskSaveDirty(ext2->disk, FILEPATH);
+}
+
+static uint32_t _blockToBG(Ext2 *ext2, uint32_t blockno) {
+	const Superblock *SB = &ext2->bgs->sb;
+	return (blockno - SB->firstDataBlock) / SB->blocksPerGroup;
+}
+
+/* Returns a zeroed BGFrees for each group */
+static BGFrees *_newFrees(Ext2 *ext2) {
+	BGFrees *frees = calloc(ext2->bgCount, sizeof(*frees));
+	if( frees == NULL ) {
+		FATAL("couldn't allocate memory for freed blocks\n");
+	}
+
+	return frees;
+}
+
+/* Drops a link to 'inodenum', and if that freed it, releases its blocks
+ * Directories take everything under them along
+ */
+static void _release(
+	Ext2 *ext2, uint32_t inodenum, bool isDir, BGFrees *frees
+) {
+	if( isDir ) {
+		Ext2Release release = { .ext2 = ext2, .frees = frees };
+		ext2DirIterate(ext2, inodenum, _releaseChild, &release);
+
+		dcacheForgetDir(ext2->dcache, inodenum);
+	}
+
+	const uint32_t BG = _inodeToBG(ext2, inodenum);
+
+	Inode inode;
+	if( bgReleaseInode(&ext2->bgs[BG], inodenum, isDir, &inode, &frees[BG]) ) {
+		ballocDiscard(ext2->balloc, inodenum);
+		_releaseBlocks(ext2, &inode, frees);
+	}
+}
+
+/* Visitor that releases each entry of a directory being deleted */
+static bool _releaseChild(Dir *dir, void *ctx) {
+	Ext2Release *release = ctx;
+
+	if( strcmp(dir->filename, ".") != 0 && strcmp(dir->filename, "..") != 0 ) {
+		_release(
+			release->ext2, dir->inode,
+			ext2GetFiletype(release->ext2, dir) == DIR_FT_DIR,
+			release->frees
+		);
+	}
+
+	return true;
+}
+
+/* Releases the data, indirect and attribute blocks of a freed inode */
+static void _releaseBlocks(Ext2 *ext2, const Inode *inode, BGFrees *frees) {
+	_releaseXattr(ext2, inode->fileACL, frees);
+
+	/* 'blocks' counts the attribute block too, in 512-byte sectors */
+	const uint32_t XATTR_SECTORS =
+		(inode->fileACL != 0) ? (uint32_t)(ext2->disk->blockSize / 512) : 0;
+
+	/* Fast symlinks keep their target in 'block', and device files their
+	 * numbers, so anything without data blocks has nothing to give back
+	 */
+	if( inode->blocks <= XATTR_SECTORS ) {
+		return;
+	}
+
+	for( int i = 0; i < INODE_DIRECT_BLOCKS; ++i ) {
+		_releaseBlock(ext2, inode->block[i], frees);
+	}
+
+	for( int level = 1; level <= BLOCKMAP_LEVELS; ++level ) {
+		_releaseIndirect(
+			ext2, inode->block[INODE_DIRECT_BLOCKS + level - 1], level, frees
+		);
+	}
+}
+
+/* Releases the indirect block 'blockno' and everything it maps, 'level' being
+ * how many indirect blocks deep its tree goes
+ */
+static void _releaseIndirect(
+	Ext2 *ext2, uint32_t blockno, int level, BGFrees *frees
+) {
+	if( blockno == 0 ) {
+		return;
+	}
+
+	DiskBlock block = diskGetBlock(ext2->disk, blockno);
+
+	for( size_t i = 0; i + 4 <= block.size; i += 4 ) {
+		const uint32_t PTR = utilLoad32(block.data + i);
+
+		if( level == 1 ) {
+			_releaseBlock(ext2, PTR, frees);
+		} else {
+			_releaseIndirect(ext2, PTR, level - 1, frees);
+		}
+	}
+
+	diskReleaseBlock(ext2->disk, &block);
+	_releaseBlock(ext2, blockno, frees);
+}
+
+static void _releaseBlock(Ext2 *ext2, uint32_t blockno, BGFrees *frees) {
+	if( blockno == 0 ) {
+		return;
+	}
+
+	const Superblock *SB = &ext2->bgs->sb;
+	if( blockno < SB->firstDataBlock || blockno >= SB->blockCount ) {
+		WARN("ignoring out-of-range block %" PRIu32 "\n", blockno);
+		return;
+	}
+
+	const uint32_t BG = _blockToBG(ext2, blockno);
+	bgReleaseBlock(&ext2->bgs[BG], blockno, &frees[BG]);
+}
+
+/* Drops a reference to the extended attribute block 'blockno', releasing it
+ * once no inode shares it anymore
+ */
+static void _releaseXattr(Ext2 *ext2, uint32_t blockno, BGFrees *frees) {
+	if( blockno == 0 ) {
+		return;
+	}
+
+	const Superblock *SB = &ext2->bgs->sb;
+	if( blockno < SB->firstDataBlock || blockno >= SB->blockCount ) {
+		WARN("ignoring out-of-range block %" PRIu32 "\n", blockno);
+		return;
+	}
+
+	const uint64_t OFFSET = diskBlockOffset(ext2->disk, blockno);
+	if( diskRead32At(ext2->disk, OFFSET) != INODE_XATTR_MAGIC ) {
+		WARN("ignoring bad attribute block %" PRIu32 "\n", blockno);
+		return;
+	}
+
+	const uint32_t REFS = diskRead32At(ext2->disk, OFFSET + 4);
+	if( REFS > 1 ) {
+		diskSeek(ext2->disk, OFFSET + 4);
+		diskWrite32(ext2->disk, REFS - 1);
+		return;
+	}
+
+	_releaseBlock(ext2, blockno, frees);
+}
+
+/* Maps a new block at logical block 'index' of 'inode', along with any
+ * indirect block missing on the way to it
+ * Blocks come out of 'run' in order, so indirect blocks sit in the run just
+ * before the blocks they map. Returns false if the filesystem is full, or the
+ * file can't map any more blocks
+ */
+static bool _mapBlock(
+	Ext2 *ext2, uint32_t inodenum, Inode *inode, uint64_t index, Ext2Run *run,
+	const char *ZERO
+) {
+	if( index < INODE_DIRECT_BLOCKS ) {
+		return _newBlock(
+			ext2, inodenum, inode, run, ZERO, &inode->block[index]
+		);
+	}
+
+	/* Which tree the block is in, and where in it */
+	const uint32_t PER_BLOCK = (uint32_t)ext2->disk->blockSize / 4;
+
+	index -= INODE_DIRECT_BLOCKS;
+	uint64_t span = PER_BLOCK;
+	int level = 1;
+	while( index >= span ) {
+		index -= span;
+		span *= PER_BLOCK;
+
+		if( ++level > BLOCKMAP_LEVELS ) {
+			ERR("inode %" PRIu32 " can't map any more blocks\n", inodenum);
+			return false;
+		}
+	}
+
+	uint32_t *root = &inode->block[INODE_DIRECT_BLOCKS + level - 1];
+	if( *root == 0 && !_newBlock(ext2, inodenum, inode, run, ZERO, root) ) {
+		return false;
+	}
+
+	uint32_t blockno = *root;
+	for( ; level > 0; --level ) {
+		span /= PER_BLOCK;
+
+		const uint64_t PTR =
+			diskBlockOffset(ext2->disk, blockno) + (index / span) * 4;
+		index %= span;
+
+		blockno = diskRead32At(ext2->disk, PTR);
+		if( blockno == 0 ) {
+			if( !_newBlock(ext2, inodenum, inode, run, ZERO, &blockno) ) {
+				return false;
+			}
+
+			diskSeek(ext2->disk, PTR);
+			diskWrite32(ext2->disk, blockno);
+		}
+	}
+
+	return true;
+}
+
+/* Hands out the next block of 'run' for 'inode', zeroed and counted in the
+ * inode's 'blocks'
+ * Once the run is used up, as many blocks as the file still needs are taken
+ * in one go, as far as its allocation window goes
+ */
+static bool _newBlock(
+	Ext2 *ext2, uint32_t inodenum, Inode *inode, Ext2Run *run,
+	const char *ZERO, uint32_t *blockno
+) {
+	if( run->left == 0 ) {
+		uint32_t count = UTIL_MAX(run->want, 1);
+		const uint32_t START =
+			ballocAllocRun(ext2->balloc, inodenum, false, run->goal, &count);
+		if( START == 0 ) {
+			return false;
+		}
+
+		run->goal = START - 1;
+		run->left = count;
+	}
+
+	const uint32_t BLOCKNO = ++run->goal;
+	--run->left;
+
+	diskSeek(ext2->disk, diskBlockOffset(ext2->disk, BLOCKNO));
+	diskWriteBuf(ext2->disk, ZERO, ext2->disk->blockSize);
+
+	inode->blocks += (uint32_t)(ext2->disk->blockSize / 512);
+
+	*blockno = BLOCKNO;
+	return true;
+}
+
+/* Writes out everything a deletion freed, group by group, then the totals in
+ * the Superblock
+ */
+static void _commitFrees(Ext2 *ext2, BGFrees *frees) {
+	uint32_t inodes = 0, blocks = 0;
+
+	for( size_t i = 0; i < ext2->bgCount; ++i ) {
+		inodes += frees[i].inodes;
+		blocks += frees[i].blocks;
+
+		bgCommitFrees(&ext2->bgs[i], &frees[i]);
+	}
+
+	if( inodes == 0 && blocks == 0 ) {
+		return;
+	}
+
+	/* Only the first group's Superblock keeps the counts, as it's the one
+	 * written out
+	 */
+	Superblock *sb = &ext2->bgs->sb;
+	sb->freeInodesCount += inodes;
+	sb->freeBlocksCount += blocks;
+
+	sbWrite(sb, ext2->disk);
+}
@@ -35,9 +35,9 @@ static void _sbMountCheckDump(uint16_t mount, uint16_t max, char out[256]);
 static void _sbTimeCheckDump(int32_t check, int32_t interval, char out[256]);
 static void _sbUUIDDump(uint8_t uuid[16], char out[33]);
 
-static void _bgDump(BlockGroupDescriptor *bgdesc, int i);
+static void _bgDump(BlockGroupDescriptor *bgdesc, uint32_t i);
 
-static void _inoDump(Inode *ino, uint32_t rev, int i);
+static void _inoDump(Inode *ino, uint32_t rev, uint32_t i);
 static void _inoUserDump(uint16_t mode, char *perms);
 static void _inoGroupDump(uint16_t mode, char *perms);
 static void _inoOtherDump(uint16_t mode, char *perms);
@@ -49,37 +49,41 @@ void ext2Dump(Ext2 *ext2, int flags) {
 	}
 
 	if( flags & DUMP_BGDESCRIPTOR ) {
-		for( int i = 0; i < 32; ++i ) {
+		const uint32_t COUNT = UTIL_MIN(ext2->bgCount, 32);
+		for( uint32_t i = 0; i < COUNT; ++i ) {
 			_bgDump(&ext2->bgs[i].desc, i);
 			putchar('\n');
 		}
 	}
 
 	if( flags & DUMP_ALL_BGDESCRIPTOR ) {
-		uint32_t blockCount = (1024 << ext2->bgs->sb.logBlockSize) / 32;
-		for( uint32_t i = 0; i < blockCount; ++i ) {
+		for( uint32_t i = 0; i < ext2->bgCount; ++i ) {
 			_bgDump(&ext2->bgs[i].desc, i);
 			putchar('\n');
 		}
 	}
 
+	Inode inode;
+
 	if( flags & DUMP_INODE ) {
-		for( int i = 0; i < 32; ++i ) {
-			_inoDump(&ext2->bgs->inodes[i], ext2->bgs->sb.revLevel, i);
+		for( uint32_t i = 0; i < 32; ++i ) {
+			ext2GetInode(ext2, i + 1, &inode);
+			_inoDump(&inode, ext2->bgs->sb.revLevel, i);
 			putchar('\n');
 		}
 	}
 
 	if( flags & DUMP_INODE_ALL ) {
 		for( uint32_t i = 0; i < ext2->bgs->sb.inodesPerGroup; ++i ) {
-			_inoDump(&ext2->bgs->inodes[i], ext2->bgs->sb.revLevel, i);
+			ext2GetInode(ext2, i + 1, &inode);
+			_inoDump(&inode, ext2->bgs->sb.revLevel, i);
 			putchar('\n');
 		}
 	}
 
 	if( flags & DUMP_INODE_ROOT ) {
-		Inode *root = &ext2->bgs->inodes[INODE_RES_ROOT_DIR];
-		_inoDump(root, ext2->bgs->sb.revLevel, INODE_RES_ROOT_DIR);
+		ext2GetInode(ext2, INODE_RES_ROOT_DIR, &inode);
+		_inoDump(&inode, ext2->bgs->sb.revLevel, INODE_RES_ROOT_DIR);
 	}
 }
 
@@ -310,8 +314,8 @@ static void _sbUUIDDump(uint8_t uuid[16], char out[33]) {
 	out[32] = '\0';
 }
 
-static void _bgDump(BlockGroupDescriptor *bgdesc, int i) {
-	printf("* Block Group Descriptor (#%d)\n", i);
+static void _bgDump(BlockGroupDescriptor *bgdesc, uint32_t i) {
+	printf("* Block Group Descriptor (#%" PRIu32 ")\n", i);
 	printf("│\n");
 
 	printf("├─ Block bitmap... %" PRIu32 "\n", bgdesc->blockBitmap);
@@ -325,12 +329,12 @@ static void _bgDump(BlockGroupDescriptor *bgdesc, int i) {
 	printf("└─ Dir inodes..... %" PRIu16 "\n", bgdesc->dirInodes);
 }
 
-static void _inoDump(Inode *ino, uint32_t revision, int i) {
+static void _inoDump(Inode *ino, uint32_t revision, uint32_t i) {
 	char perms[4];
-	int64_t size;
+	uint64_t size;
 	fmttime_t date;
 
-	printf("* Inode (#%d)\n", i);
+	printf("* Inode (#%" PRIu32 ")\n", i);
 	printf("│\n");
 
 	printf("├─┬─ Mode:\n");
@@ -361,13 +365,13 @@ static void _inoDump(Inode *ino, uint32_t revision, int i) {
 	printf("│\n");
 
 	if( revision == SB_REV_DYNAMIC ) {
-		size = (((int64_t)ino->size_hi) << 32) | ino->size_lo;
+		size = ((uint64_t)ino->size_hi << 32) | ino->size_lo;
 	} else {
 		size = ino->size_lo;
 	}
 
 	printf("├─ UID.... %" PRIu16 "\n", ino->uid);
-	printf("├─ Size... %" PRIi64 " bytes\n", size);
+	printf("├─ Size... %" PRIu64 " bytes\n", size);
 	printf("│\n");
 
 	utilFmtTime(ino->accessTime, date);
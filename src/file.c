@@ -0,0 +1,196 @@
+/* ext2p
+ * Open file
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockmap.h"
+#include "disk.h"
+#include "ext2.h"
+#include "fault.h"
+#include "inode.h"
+#include "util.h"
+
+#include "file.h"
+
+static bool _resolve(Ext2File *file, uint64_t block);
+static void _readahead(Ext2File *file, uint64_t offset);
+static bool _sendZeros(int fd, uint64_t size);
+
+/* Zeros written out for holes */
+static const char _zeros[64 * 1024];
+
+Ext2File *ext2FileOpen(Ext2 *ext2, uint32_t inodenum) {
+	Ext2File *file = malloc(sizeof(*file));
+	if( file == NULL ) {
+		FATAL("couldn't allocate memory for file\n");
+	}
+
+	ext2GetInode(ext2, inodenum, &file->inode);
+	if( (file->inode.mode & INODE_FM_TYPE) != INODE_FM_FILE ) {
+		ERR("tried to open non-file inode\n");
+		free(file);
+		return NULL;
+	}
+
+	file->disk = ext2->disk;
+	file->size = ext2GetInodeSize(ext2, inodenum, &file->inode);
+	file->blockSize = (1024 << ext2->bgs->sb.logBlockSize);
+
+	blockmapInit(&file->map, file->disk, file->blockSize, &file->inode);
+	file->blockCount = blockmapBlockCount(&file->map, file->size);
+	file->extent.length = 0;
+
+	file->lastEnd = 0;
+	file->raEnd = 0;
+	file->raWindow = FILE_READAHEAD_MIN;
+
+	return file;
+}
+
+void ext2FileClose(Ext2File *file) {
+	blockmapFree(&file->map);
+	free(file);
+}
+
+size_t ext2FileRead(Ext2File *file, uint64_t offset, void *dest, size_t size) {
+	if( offset >= file->size ) {
+		return 0;
+	}
+
+	size = UTIL_MIN(size, file->size - offset);
+	_readahead(file, offset);
+
+	char *out = dest;
+	size_t done = 0;
+	while( done < size ) {
+		const uint64_t POS = offset + done;
+		const uint64_t BLOCK = POS / file->blockSize;
+
+		if( !_resolve(file, BLOCK) ) {
+			break;
+		}
+
+		/* Copy as much of the extent as is wanted in one go */
+		const uint64_t EXTENT_END =
+			(file->extent.logical + file->extent.length) * file->blockSize;
+		const size_t CHUNK = UTIL_MIN(size - done, EXTENT_END - POS);
+
+		if( EXTENT_IS_HOLE(&file->extent) ) {
+			memset(out + done, 0, CHUNK);
+			done += CHUNK;
+			continue;
+		}
+
+		const uint64_t SKIP = POS - file->extent.logical * file->blockSize;
+		const uint64_t AT = diskBlockOffset(file->disk, file->extent.physical);
+		diskReadAt(file->disk, AT + SKIP, out + done, CHUNK);
+
+		done += CHUNK;
+	}
+
+	file->lastEnd = offset + done;
+	return done;
+}
+
+bool ext2FileSend(Ext2File *file, int fd) {
+	Extent extent;
+	uint64_t block = 0;
+
+	while( blockmapGetExtent(&file->map, block, file->blockCount, &extent) ) {
+		const uint64_t START = extent.logical * file->blockSize;
+		const uint64_t END = UTIL_MIN(
+			(extent.logical + extent.length) * file->blockSize, file->size
+		);
+
+		bool ok;
+		if( EXTENT_IS_HOLE(&extent) ) {
+			ok = _sendZeros(fd, END - START);
+		} else {
+			ok = diskSendTo(
+				file->disk, fd, diskBlockOffset(file->disk, extent.physical),
+				END - START
+			);
+		}
+
+		if( !ok ) {
+			return false;
+		}
+
+		block += extent.length;
+	}
+
+	return true;
+}
+
+/* Makes sure the cached extent covers logical block 'block'
+ *
+ * Extents are only resolved as far as the readahead window, so a huge
+ * contiguous file isn't mapped in full just to read its first block
+ */
+static bool _resolve(Ext2File *file, uint64_t block) {
+	Extent *extent = &file->extent;
+	if( block >= extent->logical && block < extent->logical + extent->length ) {
+		return true;
+	}
+
+	const uint64_t WINDOW = UTIL_MAX(file->raWindow / file->blockSize, 1);
+	const uint64_t END = UTIL_MIN(file->blockCount, block + WINDOW);
+
+	return blockmapGetExtent(&file->map, block, END, extent);
+}
+
+/* Asks for the data after a sequential read to be fetched ahead of time
+ *
+ * The window doubles with every sequential read, and collapses back to its
+ * minimum as soon as the reader jumps somewhere else
+ */
+static void _readahead(Ext2File *file, uint64_t offset) {
+	if( offset != file->lastEnd ) {
+		file->raWindow = FILE_READAHEAD_MIN;
+		file->raEnd = offset;
+	}
+
+	if( file->raEnd > offset + file->raWindow / 2 ) {
+		/* Still well ahead of the reader */
+		return;
+	}
+
+	const uint64_t START = UTIL_MAX(file->raEnd, offset);
+	const uint64_t END = UTIL_MIN(START + file->raWindow, file->size);
+
+	Extent extent;
+	uint64_t block = START / file->blockSize;
+	const uint64_t LAST = (END + file->blockSize - 1) / file->blockSize;
+
+	while( blockmapGetExtent(&file->map, block, LAST, &extent) ) {
+		if( !EXTENT_IS_HOLE(&extent) ) {
+			diskReadahead(
+				file->disk, diskBlockOffset(file->disk, extent.physical),
+				extent.length * file->blockSize
+			);
+		}
+
+		block += extent.length;
+	}
+
+	file->raEnd = END;
+	file->raWindow = UTIL_MIN(file->raWindow * 2, FILE_READAHEAD_MAX);
+}
+
+static bool _sendZeros(int fd, uint64_t size) {
+	while( size > 0 ) {
+		const size_t CHUNK = UTIL_MIN(size, sizeof(_zeros));
+		if( !utilWriteAll(fd, _zeros, CHUNK) ) {
+			return false;
+		}
+
+		size -= CHUNK;
+	}
+
+	return true;
+}
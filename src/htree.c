@@ -0,0 +1,376 @@
+/* ext2p
+ * Directory index (htree)
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "blockmap.h"
+#include "disk.h"
+#include "fault.h"
+#include "superblock.h"
+#include "util.h"
+
+#include "htree.h"
+
+/* Where the index starts in the root block, past the "." and ".." entries */
+#define HTREE_ROOT_INFO 24
+
+/* Where the index starts in other index blocks, past an empty entry */
+#define HTREE_NODE_ENTRIES 8
+
+/* Size of an index entry (a hash and a block) */
+#define HTREE_ENTRY_SIZE 8
+
+/* Hash the tree uses to mark the end of a directory, never handed out */
+#define HTREE_HASH_EOF (0x7FFFFFFFu << 1)
+
+/* Index entries only use the low 28 bits for the block */
+#define HTREE_BLOCK_MASK 0x0FFFFFFF
+
+#define HTREE_TEA_DELTA 0x9E3779B9
+
+static uint32_t _legacyHash(const char *NAME, size_t len, bool isSigned);
+static void _halfMD4(uint32_t buf[4], const uint32_t IN[8]);
+static void _tea(uint32_t buf[4], const uint32_t IN[4]);
+static void _toHashBuf(
+	const char *NAME, size_t len, uint32_t *buf, int num, bool isSigned
+);
+static uint32_t _rol(uint32_t x, int s);
+
+static bool _loadLevel(HTree *tree, int level, uint32_t logical);
+static uint32_t _entryHash(const HTreeLevel *LEVEL, uint16_t at);
+static uint32_t _entryBlock(const HTreeLevel *LEVEL, uint16_t at);
+
+uint32_t htreeHash(
+	const char *NAME, size_t len, int version, const uint32_t SEED[4]
+) {
+	uint32_t buf[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+	if( SEED != NULL && (SEED[0] | SEED[1] | SEED[2] | SEED[3]) != 0 ) {
+		memcpy(buf, SEED, sizeof(buf));
+	}
+
+	const bool SIGNED = version < HTREE_HASH_LEGACY_UNSIGNED;
+
+	uint32_t hash = 0;
+	uint32_t in[8];
+
+	switch( version ) {
+	case HTREE_HASH_LEGACY:
+	case HTREE_HASH_LEGACY_UNSIGNED:
+		hash = _legacyHash(NAME, len, SIGNED);
+		break;
+	case HTREE_HASH_HALF_MD4:
+	case HTREE_HASH_HALF_MD4_UNSIGNED:
+		while( len > 0 ) {
+			_toHashBuf(NAME, len, in, 8, SIGNED);
+			_halfMD4(buf, in);
+
+			NAME += UTIL_MIN(len, 32);
+			len -= UTIL_MIN(len, 32);
+		}
+
+		hash = buf[1];
+		break;
+	case HTREE_HASH_TEA:
+	case HTREE_HASH_TEA_UNSIGNED:
+		while( len > 0 ) {
+			_toHashBuf(NAME, len, in, 4, SIGNED);
+			_tea(buf, in);
+
+			NAME += UTIL_MIN(len, 16);
+			len -= UTIL_MIN(len, 16);
+		}
+
+		hash = buf[0];
+		break;
+	}
+
+	/* The lowest bit marks collisions in index entries */
+	hash &= ~1u;
+	if( hash == HTREE_HASH_EOF ) {
+		hash = (0x7FFFFFFFu - 1) << 1;
+	}
+
+	return hash;
+}
+
+bool htreeFind(
+	HTree *tree, Disk *disk, BlockMap *map, const Superblock *sb,
+	const char *NAME
+) {
+	tree->disk = disk;
+	tree->map = map;
+	tree->depth = 0;
+
+	if( !_loadLevel(tree, 0, 0) ) {
+		htreeFree(tree);
+		return false;
+	}
+
+	const char *INFO = tree->path[0].block.data + HTREE_ROOT_INFO;
+
+	int version = (uint8_t)INFO[4];
+	const uint8_t INFO_LEN = (uint8_t)INFO[5];
+	const uint8_t LEVELS = (uint8_t)INFO[6] + 1;
+
+	if( utilLoad32(INFO) != 0 || INFO_LEN != 8 || LEVELS > HTREE_MAX_LEVELS
+		|| version > HTREE_HASH_TEA ) {
+		WARN("directory index is damaged, scanning it instead\n");
+		htreeFree(tree);
+		return false;
+	}
+
+	if( sb->flags & SB_FLAG_UNSIGNED_HASH ) {
+		version += HTREE_HASH_LEGACY_UNSIGNED;
+	}
+
+	tree->hash = htreeHash(NAME, strlen(NAME), version, sb->dirHashSeeds);
+
+	for( int level = 0; level < LEVELS; ++level ) {
+		if( level > 0 ) {
+			const HTreeLevel *PARENT = &tree->path[level - 1];
+			if( !_loadLevel(tree, level, _entryBlock(PARENT, PARENT->at)) ) {
+				htreeFree(tree);
+				return false;
+			}
+		}
+
+		/* Find the last entry whose hash isn't above the name's (the first
+		 * entry has no hash, and covers everything below the second)
+		 */
+		HTreeLevel *curr = &tree->path[level];
+
+		uint16_t lo = 1;
+		uint16_t hi = curr->count;
+		while( lo < hi ) {
+			const uint16_t MID = lo + (hi - lo) / 2;
+			if( _entryHash(curr, MID) > tree->hash ) {
+				hi = MID;
+			} else {
+				lo = MID + 1;
+			}
+		}
+
+		curr->at = lo - 1;
+	}
+
+	return true;
+}
+
+uint32_t htreeLeaf(HTree *tree) {
+	const HTreeLevel *LAST = &tree->path[tree->depth - 1];
+	return blockmapGet(tree->map, _entryBlock(LAST, LAST->at));
+}
+
+bool htreeNext(HTree *tree) {
+	/* Find the deepest level that has an entry left to move on to */
+	int level = tree->depth - 1;
+	while( ++tree->path[level].at >= tree->path[level].count ) {
+		if( level == 0 ) {
+			return false;
+		}
+
+		--level;
+	}
+
+	/* Entries whose names collide with the previous leaf's are marked by their
+	 * lowest bit; anything else starts a different range of hashes
+	 */
+	const uint32_t HASH = _entryHash(&tree->path[level], tree->path[level].at);
+	if( (HASH & ~1u) != tree->hash ) {
+		return false;
+	}
+
+	/* Go back down, along the first entry of each level */
+	const int DEPTH = tree->depth;
+	for( int i = level + 1; i < DEPTH; ++i ) {
+		diskReleaseBlock(tree->disk, &tree->path[i].block);
+	}
+
+	tree->depth = level + 1;
+	for( ++level; level < DEPTH; ++level ) {
+		const HTreeLevel *PARENT = &tree->path[level - 1];
+		if( !_loadLevel(tree, level, _entryBlock(PARENT, PARENT->at)) ) {
+			return false;
+		}
+
+		tree->path[level].at = 0;
+	}
+
+	return true;
+}
+
+void htreeFree(HTree *tree) {
+	for( int i = 0; i < tree->depth; ++i ) {
+		diskReleaseBlock(tree->disk, &tree->path[i].block);
+	}
+
+	tree->depth = 0;
+}
+
+/* Reads the index block at logical block 'logical' of the directory into
+ * 'level', which must be the next one down
+ */
+static bool _loadLevel(HTree *tree, int level, uint32_t logical) {
+	const uint32_t PHYSICAL = blockmapGet(tree->map, logical);
+	if( PHYSICAL == 0 ) {
+		WARN("directory index points at a missing block\n");
+		return false;
+	}
+
+	HTreeLevel *curr = &tree->path[level];
+	curr->block = diskGetBlock(tree->disk, PHYSICAL);
+	tree->depth = level + 1;
+
+	size_t start = HTREE_NODE_ENTRIES;
+	if( level == 0 ) {
+		/* The root info goes first, and knows its own length */
+		const char *INFO = curr->block.data + HTREE_ROOT_INFO;
+		start = HTREE_ROOT_INFO + (uint8_t)INFO[5];
+	}
+
+	curr->entries = curr->block.data + start;
+	curr->at = 0;
+
+	/* The first entry holds the limit and count in place of a hash */
+	const uint16_t LIMIT = utilLoad16(curr->entries);
+	curr->count = utilLoad16(curr->entries + 2);
+
+	const size_t ROOM = (curr->block.size - start) / HTREE_ENTRY_SIZE;
+	if( curr->count == 0 || curr->count > LIMIT || LIMIT > ROOM ) {
+		WARN("directory index block %" PRIu32 " is damaged\n", PHYSICAL);
+		return false;
+	}
+
+	return true;
+}
+
+static uint32_t _entryHash(const HTreeLevel *LEVEL, uint16_t at) {
+	return utilLoad32(LEVEL->entries + at * HTREE_ENTRY_SIZE);
+}
+
+static uint32_t _entryBlock(const HTreeLevel *LEVEL, uint16_t at) {
+	const char *ENTRY = LEVEL->entries + at * HTREE_ENTRY_SIZE;
+	return utilLoad32(ENTRY + 4) & HTREE_BLOCK_MASK;
+}
+
+/* The original hash, from before the index format settled */
+static uint32_t _legacyHash(const char *NAME, size_t len, bool isSigned) {
+	uint32_t hash0 = 0x12A3FE2D;
+	uint32_t hash1 = 0x37ABE8F9;
+
+	for( size_t i = 0; i < len; ++i ) {
+		const int C = isSigned ? (signed char)NAME[i] : (unsigned char)NAME[i];
+
+		uint32_t hash = hash1 + (hash0 ^ (uint32_t)(C * 7152373));
+		if( hash & 0x80000000 ) {
+			hash -= 0x7FFFFFFF;
+		}
+
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return hash0 << 1;
+}
+
+#define HTREE_MD4_F(X, Y, Z) ((Z) ^ ((X) & ((Y) ^ (Z))))
+#define HTREE_MD4_G(X, Y, Z) (((X) & (Y)) + (((X) ^ (Y)) & (Z)))
+#define HTREE_MD4_H(X, Y, Z) ((X) ^ (Y) ^ (Z))
+
+#define HTREE_ROUND(F, A, B, C, D, X, S) (A = _rol(A + F(B, C, D) + (X), S))
+
+/* MD4 cut down to three rounds over eight words */
+static void _halfMD4(uint32_t buf[4], const uint32_t IN[8]) {
+	const uint32_t K2 = 013240474631u;
+	const uint32_t K3 = 015666365641u;
+
+	uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	HTREE_ROUND(HTREE_MD4_F, a, b, c, d, IN[0], 3);
+	HTREE_ROUND(HTREE_MD4_F, d, a, b, c, IN[1], 7);
+	HTREE_ROUND(HTREE_MD4_F, c, d, a, b, IN[2], 11);
+	HTREE_ROUND(HTREE_MD4_F, b, c, d, a, IN[3], 19);
+	HTREE_ROUND(HTREE_MD4_F, a, b, c, d, IN[4], 3);
+	HTREE_ROUND(HTREE_MD4_F, d, a, b, c, IN[5], 7);
+	HTREE_ROUND(HTREE_MD4_F, c, d, a, b, IN[6], 11);
+	HTREE_ROUND(HTREE_MD4_F, b, c, d, a, IN[7], 19);
+
+	HTREE_ROUND(HTREE_MD4_G, a, b, c, d, IN[1] + K2, 3);
+	HTREE_ROUND(HTREE_MD4_G, d, a, b, c, IN[3] + K2, 5);
+	HTREE_ROUND(HTREE_MD4_G, c, d, a, b, IN[5] + K2, 9);
+	HTREE_ROUND(HTREE_MD4_G, b, c, d, a, IN[7] + K2, 13);
+	HTREE_ROUND(HTREE_MD4_G, a, b, c, d, IN[0] + K2, 3);
+	HTREE_ROUND(HTREE_MD4_G, d, a, b, c, IN[2] + K2, 5);
+	HTREE_ROUND(HTREE_MD4_G, c, d, a, b, IN[4] + K2, 9);
+	HTREE_ROUND(HTREE_MD4_G, b, c, d, a, IN[6] + K2, 13);
+
+	HTREE_ROUND(HTREE_MD4_H, a, b, c, d, IN[3] + K3, 3);
+	HTREE_ROUND(HTREE_MD4_H, d, a, b, c, IN[7] + K3, 9);
+	HTREE_ROUND(HTREE_MD4_H, c, d, a, b, IN[2] + K3, 11);
+	HTREE_ROUND(HTREE_MD4_H, b, c, d, a, IN[6] + K3, 15);
+	HTREE_ROUND(HTREE_MD4_H, a, b, c, d, IN[1] + K3, 3);
+	HTREE_ROUND(HTREE_MD4_H, d, a, b, c, IN[5] + K3, 9);
+	HTREE_ROUND(HTREE_MD4_H, c, d, a, b, IN[0] + K3, 11);
+	HTREE_ROUND(HTREE_MD4_H, b, c, d, a, IN[4] + K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+/* Sixteen rounds of TEA, keyed with the name */
+static void _tea(uint32_t buf[4], const uint32_t IN[4]) {
+	uint32_t sum = 0;
+	uint32_t b0 = buf[0], b1 = buf[1];
+
+	for( int i = 0; i < 16; ++i ) {
+		sum += HTREE_TEA_DELTA;
+		b0 += ((b1 << 4) + IN[0]) ^ (b1 + sum) ^ ((b1 >> 5) + IN[1]);
+		b1 += ((b0 << 4) + IN[2]) ^ (b0 + sum) ^ ((b0 >> 5) + IN[3]);
+	}
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/* Packs up to 'num' words worth of a name into 'buf', padding out the rest
+ * with a value derived from the name's length
+ */
+static void _toHashBuf(
+	const char *NAME, size_t len, uint32_t *buf, int num, bool isSigned
+) {
+	uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+	pad |= pad << 16;
+
+	uint32_t val = pad;
+	len = UTIL_MIN(len, (size_t)num * 4);
+
+	for( size_t i = 0; i < len; ++i ) {
+		const int C = isSigned ? (signed char)NAME[i] : (unsigned char)NAME[i];
+		val = (uint32_t)C + (val << 8);
+
+		if( i % 4 == 3 ) {
+			*buf++ = val;
+			val = pad;
+			--num;
+		}
+	}
+
+	if( --num >= 0 ) {
+		*buf++ = val;
+	}
+
+	while( --num >= 0 ) {
+		*buf++ = pad;
+	}
+}
+
+static uint32_t _rol(uint32_t x, int s) {
+	return (x << s) | (x >> (32 - s));
+}
@@ -0,0 +1,200 @@
+/* ext2p
+ * Inode cache
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "disk.h"
+#include "fault.h"
+#include "inode.h"
+#include "lru.h"
+#include "util.h"
+
+#include "icache.h"
+
+static ICacheEntry *_find(ICache *icache, uint32_t inodenum);
+static void _hold(ICache *icache, ICacheEntry *entry);
+
+static void _shrink(ICache *icache, size_t budget);
+static bool _evict(ICache *icache);
+static void _removeFromBucket(ICache *icache, ICacheEntry *entry);
+
+ICache *icacheNew(Disk *disk, size_t budget) {
+	ICache *icache = malloc(sizeof(*icache));
+	if( icache == NULL ) {
+		FATAL("couldn't allocate memory for inode cache\n");
+	}
+
+	icache->disk = disk;
+
+	icache->budget = UTIL_MAX(budget, sizeof(ICacheEntry));
+	icache->used = 0;
+
+	const size_t BUCKETS =
+		lruBucketCount(icache->budget / sizeof(ICacheEntry));
+	icache->buckets = calloc(BUCKETS, sizeof(*icache->buckets));
+	if( icache->buckets == NULL ) {
+		FATAL("couldn't allocate memory for inode cache\n");
+	}
+
+	icache->bucketMask = BUCKETS - 1;
+	lruInit(&icache->lru);
+
+	memset(&icache->stats, 0, sizeof(icache->stats));
+	pthread_mutex_init(&icache->lock, NULL);
+	pthread_cond_init(&icache->filled, NULL);
+
+	return icache;
+}
+
+void icacheFree(ICache *icache) {
+	/* Held entries aren't on the LRU list, but every entry is in a bucket */
+	for( size_t i = 0; i <= icache->bucketMask; ++i ) {
+		ICacheEntry *entry = icache->buckets[i];
+		while( entry != NULL ) {
+			ICacheEntry *chain = entry->chain;
+			free(entry);
+			entry = chain;
+		}
+	}
+
+	pthread_mutex_destroy(&icache->lock);
+	pthread_cond_destroy(&icache->filled);
+
+	free(icache->buckets);
+	free(icache);
+}
+
+ICacheEntry *icacheAcquire(ICache *icache, uint32_t inodenum, uint64_t offset) {
+	pthread_mutex_lock(&icache->lock);
+
+	ICacheEntry *entry = _find(icache, inodenum);
+	if( entry != NULL ) {
+		++icache->stats.hits;
+		_hold(icache, entry);
+
+		pthread_mutex_unlock(&icache->lock);
+		return entry;
+	}
+
+	++icache->stats.misses;
+	_shrink(icache, icache->budget - sizeof(*entry));
+
+	entry = malloc(sizeof(*entry));
+	if( entry == NULL ) {
+		FATAL("couldn't allocate memory for inode\n");
+	}
+
+	entry->inodenum = inodenum;
+	entry->filling = true;
+	entry->refs = 1;
+
+	/* Held entries stay off the LRU list, but others can find this one */
+	const size_t BUCKET = lruHash(inodenum, icache->bucketMask);
+	entry->chain = icache->buckets[BUCKET];
+	icache->buckets[BUCKET] = entry;
+
+	icache->used += sizeof(*entry);
+
+	pthread_mutex_unlock(&icache->lock);
+
+	inodeRead(&entry->inode, icache->disk, offset);
+
+	pthread_mutex_lock(&icache->lock);
+	entry->filling = false;
+	pthread_cond_broadcast(&icache->filled);
+	pthread_mutex_unlock(&icache->lock);
+
+	return entry;
+}
+
+void icacheRelease(ICache *icache, ICacheEntry *entry) {
+	pthread_mutex_lock(&icache->lock);
+
+	/* Once nobody holds it, the entry can be evicted again */
+	if( --entry->refs == 0 ) {
+		lruPushFront(&icache->lru, &entry->lru);
+	}
+
+	pthread_mutex_unlock(&icache->lock);
+}
+
+void icacheSetBudget(ICache *icache, size_t budget) {
+	pthread_mutex_lock(&icache->lock);
+
+	icache->budget = UTIL_MAX(budget, sizeof(ICacheEntry));
+	_shrink(icache, icache->budget);
+
+	pthread_mutex_unlock(&icache->lock);
+}
+
+void icacheGetStats(ICache *icache, CacheStats *stats) {
+	pthread_mutex_lock(&icache->lock);
+	*stats = icache->stats;
+	pthread_mutex_unlock(&icache->lock);
+}
+
+static ICacheEntry *_find(ICache *icache, uint32_t inodenum) {
+	ICacheEntry *entry =
+		icache->buckets[lruHash(inodenum, icache->bucketMask)];
+	while( entry != NULL && entry->inodenum != inodenum ) {
+		entry = entry->chain;
+	}
+
+	return entry;
+}
+
+/* Takes a reference to 'entry', waiting for it if it's still being read in
+ * Called with the lock held
+ */
+static void _hold(ICache *icache, ICacheEntry *entry) {
+	if( entry->refs++ == 0 ) {
+		lruUnlink(&icache->lru, &entry->lru);
+	}
+
+	while( entry->filling ) {
+		pthread_cond_wait(&icache->filled, &icache->lock);
+	}
+}
+
+/* Evicts entries until at most 'budget' bytes are in use, or until all that's
+ * left is held by someone
+ */
+static void _shrink(ICache *icache, size_t budget) {
+	while( icache->used > budget && _evict(icache) ) {
+	}
+}
+
+/* Drops the least recently used entry nobody holds
+ * Returns false if there's no such entry
+ */
+static bool _evict(ICache *icache) {
+	if( icache->lru.tail == NULL ) {
+		return false;
+	}
+
+	ICacheEntry *entry = LRU_ENTRY(icache->lru.tail, ICacheEntry);
+	lruUnlink(&icache->lru, &entry->lru);
+	_removeFromBucket(icache, entry);
+	free(entry);
+
+	icache->used -= sizeof(*entry);
+	++icache->stats.evictions;
+
+	return true;
+}
+
+static void _removeFromBucket(ICache *icache, ICacheEntry *entry) {
+	ICacheEntry **link =
+		&icache->buckets[lruHash(entry->inodenum, icache->bucketMask)];
+	while( *link != entry ) {
+		link = &(*link)->chain;
+	}
+
+	*link = entry->chain;
+}
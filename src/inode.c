@@ -3,14 +3,15 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "disk.h"
 
 #include "inode.h"
 
-bool inodeRead(Inode *inode, Disk *disk) {
-	diskCopy(disk, inode, 128);
+bool inodeRead(Inode *inode, Disk *disk, uint64_t offset) {
+	diskReadAt(disk, offset, inode, 128);
 
 	return true;
 }
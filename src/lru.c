@@ -0,0 +1,56 @@
+/* ext2p
+ * LRU lists
+ */
+
+#include <stddef.h>
+
+#include "lru.h"
+
+void lruInit(LRUList *list) {
+	list->head = NULL;
+	list->tail = NULL;
+}
+
+void lruUnlink(LRUList *list, LRUNode *node) {
+	if( node->prev != NULL ) {
+		node->prev->next = node->next;
+	} else {
+		list->head = node->next;
+	}
+
+	if( node->next != NULL ) {
+		node->next->prev = node->prev;
+	} else {
+		list->tail = node->prev;
+	}
+}
+
+void lruPushFront(LRUList *list, LRUNode *node) {
+	node->prev = NULL;
+	node->next = list->head;
+
+	if( list->head != NULL ) {
+		list->head->prev = node;
+	}
+
+	list->head = node;
+	if( list->tail == NULL ) {
+		list->tail = node;
+	}
+}
+
+void lruTouch(LRUList *list, LRUNode *node) {
+	if( node != list->head ) {
+		lruUnlink(list, node);
+		lruPushFront(list, node);
+	}
+}
+
+size_t lruBucketCount(size_t entries) {
+	size_t count = 64;
+	while( count < entries * 2 ) {
+		count <<= 1;
+	}
+
+	return count;
+}
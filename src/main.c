@@ -5,23 +5,46 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "shell.h"
+#include "util.h"
 
 static void _usage(void);
 
 int main(int argc, char *argv[]) {
 	char *img = NULL;
-	if( argc > 2 ) {
+	size_t cacheSize = 0;
+	size_t inodeCacheSize = 0;
+
+	int arg = 1;
+	while( arg < argc && argv[arg][0] == '-' ) {
+		size_t *size = NULL;
+		if( strcmp(argv[arg], "-c") == 0 ) {
+			size = &cacheSize;
+		} else if( strcmp(argv[arg], "-i") == 0 ) {
+			size = &inodeCacheSize;
+		}
+
+		if( size == NULL || arg + 1 >= argc
+			|| !utilParseSize(argv[arg + 1], size) ) {
+			_usage();
+			exit(EXIT_FAILURE);
+		}
+
+		arg += 2;
+	}
+
+	if( argc - arg > 1 ) {
 		_usage();
 		exit(EXIT_FAILURE);
 	}
 
-	if( argc == 2 ) {
-		img = argv[1];
+	if( argc - arg == 1 ) {
+		img = argv[arg];
 	}
 
-	Shell *shell = shellOpen(img);
+	Shell *shell = shellOpen(img, cacheSize, inodeCacheSize);
 	if( shell == NULL ) {
 		return EXIT_FAILURE;
 	}
@@ -30,5 +53,11 @@ int main(int argc, char *argv[]) {
 }
 
 static void _usage(void) {
-	printf("usage: ext2p [IMAGE]\n");
+	printf("usage: ext2p [-c CACHE_SIZE] [-i INODE_CACHE_SIZE] [IMAGE]\n");
+	printf("  -c CACHE_SIZE   read the image through a block cache of at\n");
+	printf("                  most CACHE_SIZE bytes (K, M and G suffixes\n");
+	printf("                  are accepted) instead of mapping it\n");
+	printf("  -i INODE_CACHE_SIZE\n");
+	printf("                  keep at most INODE_CACHE_SIZE bytes of\n");
+	printf("                  decoded inodes in memory (default 256K)\n");
 }
@@ -17,11 +17,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "dcache.h"
 #include "dir.h"
 #include "ext2.h"
 #include "ext2dump.h"
 #include "fault.h"
+#include "file.h"
 #include "inode.h"
 
 #include "shell.h"
@@ -36,11 +39,14 @@ typedef struct _ShellCommand {
 	bool needsMount;
 } ShellCommand;
 
+SHELL_FN(cache);
 SHELL_FN(cat);
 SHELL_FN(cd);
+SHELL_FN(check);
 SHELL_FN(clear);
 SHELL_FN(exit);
 SHELL_FN(fsdump);
+SHELL_FN(grow);
 SHELL_FN(help);
 SHELL_FN(ls);
 SHELL_FN(man);
@@ -52,13 +58,16 @@ SHELL_FN(stat);
 SHELL_FN(umount);
 
 static ShellCommand _shellCommands[] = {
+	{ "cache", _shell_cache, true }, /* displays cache counters */
 	{ "cat", _shell_cat, true }, /* displays file contents */
 	{ "cd", _shell_cd, true }, /* changes the current directory */
+	{ "check", _shell_check, true }, /* checks the free counts */
 	{ "clear", _shell_clear, false }, /* clears the screen */
 	{ "cls", _shell_clear, false }, /* clears the screen */
 	{ "dir", _shell_ls, true }, /* lists a directory's contents */
 	{ "exit", _shell_exit, false }, /* exits the shell */
 	{ "fsdump", _shell_fsdump, true }, /* dumps filesystem info */
+	{ "grow", _shell_grow, true }, /* appends blocks to a file */
 	{ "help", _shell_help, false }, /* prints help information */
 	{ "ls", _shell_ls, true }, /* lists a directory's contents */
 	{ "man", _shell_man, false }, /* display command documentation */
@@ -81,18 +90,32 @@ static int _getArgs(char *buf, char *argv[64]);
 
 static void _tryLevenshtein(char *buf);
 
-static bool _getFile(Shell *shell, char *filename, Dir *root, Dir **dir);
-static Dir *_findInode(Dir *root, char *filename);
+static bool _findInode(
+	Shell *shell, const char *PATH, uint32_t *inode, uint8_t *filetype
+);
+static bool _getFile(
+	Shell *shell, const char *PATH, uint32_t *parent, DirList *list, Dir **dir
+);
+static void _followPath(Shell *shell, const char *PATH);
 
 static char *_humanizeSize(uint64_t bytes, char *hrbytes);
 
-Shell *shellOpen(const char *IMGPATH) {
+static Ext2 *_openImage(Shell *shell, const char *IMGPATH);
+static void _printCacheStats(
+	const CacheStats *stats, size_t usedBytes, size_t budgetBytes
+);
+
+Shell *shellOpen(
+	const char *IMGPATH, size_t cacheSize, size_t inodeCacheSize
+) {
 	Shell *shell = malloc(sizeof(*shell));
+	shell->cacheSize = cacheSize;
+	shell->inodeCacheSize = inodeCacheSize;
 
 	if( IMGPATH == NULL ) {
 		shell->fs = NULL;
 	} else {
-		shell->fs = ext2Open(IMGPATH);
+		shell->fs = _openImage(shell, IMGPATH);
 		if( shell->fs == NULL ) {
 			WARN(
 				"'%s' is not a valid image; starting shell unmounted", IMGPATH
@@ -226,6 +249,46 @@ static void _tryLevenshtein(char *buf) {
 	printf(" (did you mean '%s'?)\n", bestCmd);
 }
 
+SHELL_FN(cache) {
+	UNUSED(argc);
+	UNUSED(argv);
+
+	BGStats groups;
+	bgGetStats(shell->fs->bgs, shell->fs->bgCount, &groups);
+
+	/* Group metadata is only read as it's needed */
+	puts("metadata:");
+	printf("  groups....... %zu\n", groups.groups);
+	printf("  inode bitmaps %zu read\n", groups.inodeBitmaps);
+	printf("  block bitmaps %zu read\n\n", groups.blockBitmaps);
+
+	CacheStats stats;
+	icacheGetStats(shell->fs->icache, &stats);
+
+	puts("inodes:");
+	_printCacheStats(
+		&stats, shell->fs->icache->used, shell->fs->icache->budget
+	);
+
+	dcacheGetStats(shell->fs->dcache, &stats);
+
+	puts("\ndentries:");
+	_printCacheStats(
+		&stats, shell->fs->dcache->used, shell->fs->dcache->budget
+	);
+
+	puts("\nblocks:");
+	if( !diskGetCacheStats(shell->fs->disk, &stats) ) {
+		puts("  image is mapped, not cached (run ext2p with -c to cache it)");
+		return EXIT_SUCCESS;
+	}
+
+	Cache *cache = shell->fs->disk->cache;
+	_printCacheStats(&stats, cache->used, cache->budget);
+
+	return EXIT_SUCCESS;
+}
+
 SHELL_FN(cat) {
 	if( argc != 2 ) {
 		puts("usage: cat [file]");
@@ -234,26 +297,34 @@ SHELL_FN(cat) {
 
 	char *filename = argv[1];
 
-	Dir root, *dir;
-	if( !_getFile(shell, filename, &root, &dir) ) {
+	uint32_t inode;
+	uint8_t filetype;
+	if( !_findInode(shell, filename, &inode, &filetype) ) {
+		return EXIT_FAILURE;
+	}
+
+	if( filetype != DIR_FT_FILE ) {
+		ERR(
+			"'%s' is not a file (is a %s)\n", filename,
+			dirFiletypeName(filetype)
+		);
 		return EXIT_FAILURE;
 	}
 
-	if( dir->filetype != DIR_FT_FILE ) {
-		ERR("'%s' is not a file (is a %s)\n", filename, dirGetFiletype(dir));
+	Ext2File *file = ext2FileOpen(shell->fs, inode);
 
-		dirFreeLinkedList(&root);
+	if( file == NULL ) {
 		return EXIT_FAILURE;
 	}
 
-	FP data;
-	ext2ReadFile(shell->fs, dir->inode, &data);
-	for( size_t i = 0; i < data.size; ++i ) {
-		putchar(utilRead8(&data));
+	/* Anything already printed has to come out before the file does */
+	fflush(stdout);
+
+	if( !ext2FileSend(file, STDOUT_FILENO) ) {
+		ERR("couldn't write out '%s'\n", filename);
 	}
 
-	utilFreeFile(&data);
-	dirFreeLinkedList(&root);
+	ext2FileClose(file);
 
 	return EXIT_SUCCESS;
 }
@@ -265,38 +336,35 @@ SHELL_FN(cd) {
 	}
 
 	char *into = argv[1];
-	if( strcmp(into, ".") == 0 ) {
-		return EXIT_SUCCESS;
-	}
 
-	Dir root, *dir;
-	if( !_getFile(shell, into, &root, &dir) ) {
+	uint32_t inode;
+	uint8_t filetype;
+	if( !_findInode(shell, into, &inode, &filetype) ) {
 		return EXIT_FAILURE;
 	}
 
-	if( dir->filetype != DIR_FT_DIR ) {
-		ERR("'%s' is not a dir (is a %s)\n", into, dirGetFiletype(dir));
-
-		dirFreeLinkedList(&root);
+	if( filetype != DIR_FT_DIR ) {
+		ERR("'%s' is not a dir (is a %s)\n", into, dirFiletypeName(filetype));
 		return EXIT_FAILURE;
 	}
 
-	shell->cd = dir->inode;
+	_followPath(shell, into);
+	shell->cd = inode;
 
-	if( strcmp(into, "..") == 0 ) {
-		if( shell->pathLevel > 0 ) {
-			--shell->pathLevel;
-		}
-	} else if( shell->pathLevel < 127 ) {
-		shell->path[shell->pathLevel].inode = dir->inode;
-		strncpy(
-			shell->path[shell->pathLevel].name, dir->filename, dir->nameLen + 1
-		);
+	return EXIT_SUCCESS;
+}
+
+SHELL_FN(check) {
+	UNUSED(argc);
+	UNUSED(argv);
 
-		++shell->pathLevel;
+	if( !ext2CheckCounts(shell->fs) ) {
+		return EXIT_FAILURE;
 	}
 
-	dirFreeLinkedList(&root);
+	printf(
+		"free counts match the bitmaps in all %zu groups\n", shell->fs->bgCount
+	);
 	return EXIT_SUCCESS;
 }
 
@@ -386,6 +454,40 @@ SHELL_FN(fsdump) {
 	return EXIT_SUCCESS;
 }
 
+SHELL_FN(grow) {
+	if( argc != 3 ) {
+		puts("usage: grow [file] [blocks]");
+		return EXIT_FAILURE;
+	}
+
+	char *end;
+	const unsigned long COUNT = strtoul(argv[2], &end, 10);
+	if( end == argv[2] || *end != '\0' || COUNT == 0 || COUNT > UINT32_MAX ) {
+		ERR("'%s' is not a valid block count\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	uint32_t inode;
+	uint8_t filetype;
+	if( !_findInode(shell, argv[1], &inode, &filetype) ) {
+		return EXIT_FAILURE;
+	}
+
+	if( filetype != DIR_FT_FILE ) {
+		ERR(
+			"'%s' is not a file (is a %s)\n", argv[1],
+			dirFiletypeName(filetype)
+		);
+		return EXIT_FAILURE;
+	}
+
+	if( !ext2ExtendFile(shell->fs, inode, (uint32_t)COUNT) ) {
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
 SHELL_FN(help) {
 	UNUSED(shell);
 	UNUSED(argc);
@@ -399,13 +501,16 @@ SHELL_FN(help) {
 	putchar('\n');
 
 	puts("commands:");
+	puts("  cache            displays cache and metadata counters");
 	puts("  cat              displays the contents of a file");
 	puts("  cd               changes the current directory");
+	puts("  check            checks the free counts against the bitmaps");
 	puts("  clear            clears the screen");
 	puts("  cls              'clear' alias -- clears the screen");
 	puts("  dir              'ls' alias -- lists the contents of a directory");
 	puts("  exit             exits the shell");
 	puts("  fsdump           dumps information about the filesystem");
+	puts("  grow             appends zeroed blocks to a file");
 	puts("  help             display this help text");
 	puts("  ls               lists the contents of a directory");
 	puts("  man              displays the documentation for a command");
@@ -423,33 +528,24 @@ SHELL_FN(help) {
 	return EXIT_SUCCESS;
 }
 
-SHELL_FN(ls) {
-	UNUSED(argc);
-	UNUSED(argv);
+static bool _lsEntry(Dir *dir, void *ctx) {
+	UNUSED(ctx);
 
-	Dir root;
-	if( !ext2GetDir(shell->fs, shell->cd, &root) ) {
-		dirFreeLinkedList(&root);
-		return EXIT_FAILURE;
+	if( strcmp(dir->filename, ".") != 0 && strcmp(dir->filename, "..") != 0 ) {
+		printf("  %-7s %s\n", dirGetFiletype(dir), dir->filename);
 	}
 
-	Dir *dir = &root;
-	while( true ) {
-		if( dir == NULL ) {
-			break;
-		}
+	return true;
+}
 
-		if( strcmp(dir->filename, ".") == 0
-			|| strcmp(dir->filename, "..") == 0 ) {
-			dir = dir->next;
-			continue;
-		}
+SHELL_FN(ls) {
+	UNUSED(argc);
+	UNUSED(argv);
 
-		printf("  %-7s %s\n", dirGetFiletype(dir), dir->filename);
-		dir = dir->next;
+	if( !ext2DirIterate(shell->fs, shell->cd, _lsEntry, NULL) ) {
+		return EXIT_FAILURE;
 	}
 
-	dirFreeLinkedList(&root);
 	return EXIT_SUCCESS;
 }
 
@@ -475,7 +571,7 @@ SHELL_FN(mount) {
 	}
 
 	char *img = argv[1];
-	shell->fs = ext2Open(img);
+	shell->fs = _openImage(shell, img);
 
 	if( shell->fs == NULL ) {
 		ERR("couldn't mount image at '%s'", img);
@@ -493,64 +589,103 @@ SHELL_FN(rm) {
 
 	char *filename = argv[1];
 
-	Dir root, *dir;
-	if( !_getFile(shell, filename, &root, &dir) ) {
+	uint32_t parent;
+	DirList list;
+	Dir *dir;
+	if( !_getFile(shell, filename, &parent, &list, &dir) ) {
 		return EXIT_FAILURE;
 	}
 
-	if( dir->filetype != DIR_FT_FILE ) {
-		ERR("'%s' is not a file (is a %s)\n", filename, dirGetFiletype(dir));
+	const uint8_t TYPE = ext2GetFiletype(shell->fs, dir);
+	if( TYPE != DIR_FT_FILE ) {
+		ERR(
+			"'%s' is not a file (is a %s)\n", filename, dirFiletypeName(TYPE)
+		);
 
-		dirFreeLinkedList(&root);
+		dirListFree(&list);
 		return EXIT_FAILURE;
 	}
 
-	if( !ext2DeleteFile(shell->fs, &root, dir) ) {
-		dirFreeLinkedList(&root);
+	if( !ext2DeleteFile(shell->fs, parent, dir) ) {
+		dirListFree(&list);
 		return EXIT_FAILURE;
 	}
 
-	dirFreeLinkedList(&root);
+	dirListFree(&list);
 	return EXIT_SUCCESS;
 }
 
 SHELL_FN(rmdir) {
-	UNUSED(shell);
-	UNUSED(argc);
-	UNUSED(argv);
+	if( argc != 2 ) {
+		puts("usage: rmdir [dir]");
+		return EXIT_FAILURE;
+	}
 
 	char *filename = argv[1];
 
-	Dir root, *dir;
-	if( !_getFile(shell, filename, &root, &dir) ) {
+	uint32_t parent;
+	DirList list;
+	Dir *dir;
+	if( !_getFile(shell, filename, &parent, &list, &dir) ) {
 		return EXIT_FAILURE;
 	}
 
-	if( dir->filetype != DIR_FT_DIR ) {
-		ERR("'%s' is not a dir (is a %s)\n", filename, dirGetFiletype(dir));
+	const uint8_t TYPE = ext2GetFiletype(shell->fs, dir);
+	if( TYPE != DIR_FT_DIR ) {
+		ERR(
+			"'%s' is not a dir (is a %s)\n", filename, dirFiletypeName(TYPE)
+		);
 
-		dirFreeLinkedList(&root);
+		dirListFree(&list);
 		return EXIT_FAILURE;
 	}
 
-	if( !ext2DeleteDir(shell->fs, &root, dir) ) {
-		dirFreeLinkedList(&root);
+	/* The shell would be left standing in a directory that's gone */
+	bool inUse = dir->inode == shell->cd;
+	for( int i = 0; i < shell->pathLevel; ++i ) {
+		inUse |= dir->inode == shell->path[i].inode;
+	}
+
+	if( inUse ) {
+		ERR("'%s' is the current dir, or above it\n", filename);
+
+		dirListFree(&list);
+		return EXIT_FAILURE;
+	}
+
+	if( !ext2DeleteDir(shell->fs, parent, dir) ) {
+		dirListFree(&list);
 		return EXIT_FAILURE;
 	}
 
-	dirFreeLinkedList(&root);
+	dirListFree(&list);
 	return EXIT_SUCCESS;
 }
 
+static void _saveUsage(void) {
+	puts("usage: save [-d] [filename]");
+	puts("  (no args)       writes changed blocks back to the mounted image");
+	puts("  filename        writes the whole image to 'filename'");
+	puts("  -d filename     writes changed blocks to 'filename', which must");
+	puts("                  be a copy of the mounted image");
+}
+
 SHELL_FN(save) {
-	if( argc != 2 ) {
-		puts("usage: save [filename]");
-		return EXIT_FAILURE;
+	if( argc == 1 ) {
+		return ext2SaveDirty(shell->fs, NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	ext2SaveToFile(shell->fs, argv[1]);
+	if( argc == 2 && strcmp(argv[1], "-d") != 0 ) {
+		ext2SaveToFile(shell->fs, argv[1]);
+		return EXIT_SUCCESS;
+	}
 
-	return EXIT_SUCCESS;
+	if( argc == 3 && strcmp(argv[1], "-d") == 0 ) {
+		return ext2SaveDirty(shell->fs, argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	_saveUsage();
+	return EXIT_FAILURE;
 }
 
 SHELL_FN(stat) {
@@ -561,29 +696,36 @@ SHELL_FN(stat) {
 
 	char *filename = argv[1];
 
-	Dir root, *dir;
-	if( !_getFile(shell, filename, &root, &dir) ) {
+	uint32_t inodenum;
+	uint8_t filetype;
+	if( !_findInode(shell, filename, &inodenum, &filetype) ) {
 		return EXIT_FAILURE;
 	}
 
 	Inode inode;
-	ext2GetInode(shell->fs, dir->inode, &inode);
+	ext2GetInode(shell->fs, inodenum, &inode);
 
 	char humansize[BUFSIZ];
-	uint64_t size = ext2GetInodeSize(shell->fs, dir->inode, &inode);
+	uint64_t size = ext2GetInodeSize(shell->fs, inodenum, &inode);
 	_humanizeSize(size, humansize);
 
-	uint32_t maxblock = inode.blocks / (2 << shell->fs->bgs->sb.logBlockSize);
+	uint64_t maxblock = ext2GetDataBlocks(shell->fs, inodenum, &inode);
+
+	/* Holes take no space, so this can be less than the size */
+	char humanalloc[BUFSIZ];
+	const uint32_t BLOCK_SIZE = (1024 << shell->fs->bgs->sb.logBlockSize);
+	_humanizeSize(maxblock * BLOCK_SIZE, humanalloc);
 
 	puts("data:");
-	printf("  name.... %s\n", dir->filename);
-	printf("  type.... %s\n", dirGetFiletype(dir));
+	printf("  name.... %s\n", filename);
+	printf("  type.... %s\n", dirFiletypeName(filetype));
 	printf(
-		"  size.... %-8s blocks... %-6" PRIu32 " fs blocks... %" PRIu32 "\n",
+		"  size.... %-8s blocks... %-6" PRIu32 " fs blocks... %" PRIu64 "\n",
 		humansize, inode.blocks, maxblock
 	);
+	printf("  alloc... %s\n", humanalloc);
 	printf(
-		"  inode... %-8" PRIu32 " links.... %" PRIu16 "\n\n", dir->inode,
+		"  inode... %-8" PRIu32 " links.... %" PRIu16 "\n\n", inodenum,
 		inode.linkCount
 	);
 
@@ -603,7 +745,6 @@ SHELL_FN(stat) {
 	utilFmtTime(inode.deleteTime, date);
 	printf("  delete... %s\n", date);
 
-	dirFreeLinkedList(&root);
 	return EXIT_SUCCESS;
 }
 
@@ -625,49 +766,126 @@ SHELL_FN(umount) {
 	return EXIT_SUCCESS;
 }
 
-static bool _getFile(Shell *shell, char *filename, Dir *root, Dir **dir) {
-	if( !ext2GetDir(shell->fs, shell->cd, root) ) {
-		dirFreeLinkedList(root);
+static Ext2 *_openImage(Shell *shell, const char *IMGPATH) {
+	Ext2 *fs;
+	if( shell->cacheSize == 0 ) {
+		fs = ext2Open(IMGPATH);
+	} else {
+		fs = ext2OpenCached(IMGPATH, shell->cacheSize);
+	}
+
+	if( fs != NULL && shell->inodeCacheSize != 0 ) {
+		ext2SetInodeCacheSize(fs, shell->inodeCacheSize);
+	}
+
+	return fs;
+}
+
+static bool _findInode(
+	Shell *shell, const char *PATH, uint32_t *inode, uint8_t *filetype
+) {
+	if( !ext2Lookup(shell->fs, shell->cd, PATH, inode, filetype) ) {
+		ERR("'%s' not found\n", PATH);
 		return false;
 	}
 
-	*dir = _findInode(root, filename);
-	if( *dir == NULL ) {
-		dirFreeLinkedList(root);
+	return true;
+}
+
+/* Finds the entry 'PATH' leads to, along with the directory it's in */
+static bool _getFile(
+	Shell *shell, const char *PATH, uint32_t *parent, DirList *list, Dir **dir
+) {
+	dirListInit(list);
+
+	/* Split the path into the directory and the name in it */
+	const char *NAME = strrchr(PATH, '/');
+	if( NAME == NULL ) {
+		NAME = PATH;
+		*parent = shell->cd;
+	} else {
+		char dirpath[PATH_MAX];
+		const size_t LEN = (size_t)(NAME - PATH);
+		if( LEN >= sizeof(dirpath) ) {
+			ERR("'%s' not found\n", PATH);
+			return false;
+		}
+
+		/* A leading slash on its own still means the root */
+		memcpy(dirpath, PATH, LEN);
+		dirpath[LEN] = '\0';
+		if( LEN == 0 ) {
+			strcpy(dirpath, "/");
+		}
+
+		uint8_t filetype;
+		if( !ext2Lookup(shell->fs, shell->cd, dirpath, parent, &filetype)
+			|| filetype != DIR_FT_DIR ) {
+			ERR("'%s' not found\n", PATH);
+			return false;
+		}
+
+		++NAME;
+	}
+
+	if( !ext2FindEntry(shell->fs, *parent, NAME, list, dir) ) {
+		ERR("'%s' not found\n", PATH);
+		dirListFree(list);
 		return false;
 	}
 
 	return true;
 }
 
-static Dir *_findInode(Dir *root, char *filename) {
-	bool found = false;
+/* Keeps the prompt's path in step with a 'cd' along 'PATH', which has to be
+ * done before 'shell->cd' moves
+ * The walk has just been resolved, so each step is a dentry cache hit
+ */
+static void _followPath(Shell *shell, const char *PATH) {
+	uint32_t at = shell->cd;
+	if( PATH[0] == '/' ) {
+		at = INODE_RES_ROOT_DIR;
+		shell->pathLevel = 0;
+	}
+
+	char name[DIR_NAME_MAX + 1];
 
-	Dir *dir = root;
+	const char *component = PATH;
 	while( true ) {
-		if( dir == NULL ) {
+		component += strspn(component, "/");
+		if( *component == '\0' ) {
 			break;
 		}
 
-		if( strcmp(dir->filename, filename) == 0 ) {
-			found = true;
-			break;
+		const size_t LEN = strcspn(component, "/");
+		snprintf(name, sizeof(name), "%.*s", (int)LEN, component);
+		component += LEN;
+
+		uint8_t filetype;
+		if( strcmp(name, ".") == 0
+			|| !ext2FindInode(shell->fs, at, name, &at, &filetype) ) {
+			continue;
 		}
 
-		dir = dir->next;
-	}
+		if( strcmp(name, "..") == 0 ) {
+			if( shell->pathLevel > 0 ) {
+				--shell->pathLevel;
+			}
+		} else if( shell->pathLevel < 127 ) {
+			shell->path[shell->pathLevel].inode = at;
+			snprintf(
+				shell->path[shell->pathLevel].name,
+				sizeof(shell->path[shell->pathLevel].name), "%s", name
+			);
 
-	if( !found ) {
-		ERR("'%s' not found\n", filename);
-		return NULL;
+			++shell->pathLevel;
+		}
 	}
-
-	return dir;
 }
 
 static char *_humanizeSize(uint64_t bytes, char *out) {
 	int i;
-	for( i = 0; i < SUFFIX_LEN; i++ ) {
+	for( i = 0; i < SUFFIX_LEN - 1; i++ ) {
 		if( bytes < 1024 ) {
 			break;
 		}
@@ -675,6 +893,22 @@ static char *_humanizeSize(uint64_t bytes, char *out) {
 		bytes >>= 10;
 	}
 
-	snprintf(out, BUFSIZ, "%lu%s", bytes, SUFFIX[i]);
+	snprintf(out, BUFSIZ, "%" PRIu64 "%s", bytes, SUFFIX[i]);
 	return out;
 }
+
+static void _printCacheStats(
+	const CacheStats *stats, size_t usedBytes, size_t budgetBytes
+) {
+	char used[BUFSIZ], budget[BUFSIZ];
+	_humanizeSize(usedBytes, used);
+	_humanizeSize(budgetBytes, budget);
+
+	const uint64_t LOOKUPS = stats->hits + stats->misses;
+	const double HIT_RATE = LOOKUPS ? (100.0 * stats->hits) / LOOKUPS : 0.0;
+
+	printf("  used....... %s of %s\n", used, budget);
+	printf("  hits....... %" PRIu64 " (%.2f%%)\n", stats->hits, HIT_RATE);
+	printf("  misses..... %" PRIu64 "\n", stats->misses);
+	printf("  evictions.. %" PRIu64 "\n", stats->evictions);
+}
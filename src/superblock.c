@@ -11,7 +11,7 @@
 #include "superblock.h"
 
 bool sbRead(Superblock *sb, Disk *disk) {
-	diskCopy(disk, sb, SB_SIZE);
+	diskReadAt(disk, SB_OFFSET, sb, SB_SIZE);
 
 	if( sb->magic != EXT2_SUPER_MAGIC ) {
 		ERR("Superblock has bad magic %04X (should be EF53)", sb->magic);
@@ -34,7 +34,10 @@ bool sbRead(Superblock *sb, Disk *disk) {
 		WARN("Superblock has bad rev. '%" PRIu32 "', ignoring", sb->revLevel);
 	}
 
-	diskSkip(disk, 760);
-
 	return true;
 }
+
+void sbWrite(const Superblock *sb, Disk *disk) {
+	diskSeek(disk, SB_OFFSET);
+	diskWriteBuf(disk, sb, SB_SIZE);
+}
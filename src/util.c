@@ -2,12 +2,14 @@
  * Utilities
  */
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "fault.h"
 
@@ -142,11 +144,65 @@ void utilWrite64(FILE *file, uint64_t data) {
 	fputc(UTIL_SHFR(data, 24), file);
 }
 
+bool utilWriteAll(int fd, const void *src, size_t size) {
+	const char *in = src;
+	while( size > 0 ) {
+		const ssize_t WRITTEN = write(fd, in, size);
+		if( WRITTEN < 0 && errno == EINTR ) {
+			continue;
+		}
+
+		if( WRITTEN <= 0 ) {
+			return false;
+		}
+
+		in += WRITTEN;
+		size -= WRITTEN;
+	}
+
+	return true;
+}
+
 size_t utilFmtTime(time_t time, fmttime_t ftime) {
 	const struct tm *TIME_TM = localtime(&time);
 	return strftime(ftime, BUFSIZ, "%a, %d %b %Y %T %z", TIME_TM);
 }
 
+bool utilParseSize(const char *STR, size_t *size) {
+	char *end;
+	unsigned long long value = strtoull(STR, &end, 10);
+	if( end == STR ) {
+		return false;
+	}
+
+	switch( *end ) {
+	case '\0':
+		break;
+	case 'g':
+	case 'G':
+		value <<= 10;
+		/* fallthrough */
+	case 'm':
+	case 'M':
+		value <<= 10;
+		/* fallthrough */
+	case 'k':
+	case 'K':
+		value <<= 10;
+		++end;
+		break;
+	default:
+		return false;
+	}
+
+	if( *end != '\0' ) {
+		return false;
+	}
+
+	*size = (size_t)value;
+	return true;
+}
+
 int utilLevenshtein(const char *A, const char *B) {
 	size_t asz = strlen(A);
 	size_t bsz = strlen(B);
@@ -0,0 +1,205 @@
+/* ext2p
+ * Block allocator test
+ *
+ * Allocates blocks on a freshly made image the way files being extended ask
+ * for them, and checks that they come out contiguous: one file on its own
+ * gets one run, and two files growing side by side get runs at least a window
+ * long each. Then fills the image up to one block short, and extends a file
+ * that needs an indirect block as well as that one, and fills it the rest of
+ * the way, which has to stop at the reserved blocks. The free counts have to
+ * match the bitmaps throughout
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "balloc.h"
+#include "ext2.h"
+#include "inode.h"
+#include "superblock.h"
+
+#define TEST_BLOCKS 256
+
+/* A file using up exactly the direct blocks, which the image is made with */
+#define TEST_FILE "/twelve"
+
+/* Free inodes on the image, standing in for files being written */
+#define TEST_INODE_A 13
+#define TEST_INODE_B 14
+#define TEST_INODE_C 15
+
+static bool _testSingle(Ext2 *ext2);
+static bool _testInterleaved(Ext2 *ext2);
+static bool _testIndirect(Ext2 *ext2);
+static bool _testFull(Ext2 *ext2);
+static bool _checkRuns(const char *NAME, const uint32_t *blocks, size_t count);
+
+int main(int argc, char **argv) {
+	if( argc != 2 ) {
+		fprintf(stderr, "usage: %s [image]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Ext2 *ext2 = ext2Open(argv[1]);
+	if( ext2 == NULL ) {
+		fprintf(stderr, "couldn't open '%s'\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	/* Later tests use up what earlier ones leave, so they run in order */
+	const bool OK = _testSingle(ext2) && _testInterleaved(ext2)
+		&& _testIndirect(ext2) && _testFull(ext2);
+
+	ext2Free(ext2);
+	return OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* One file extended a block at a time gets a single run */
+static bool _testSingle(Ext2 *ext2) {
+	uint32_t blocks[TEST_BLOCKS];
+
+	uint32_t goal = 0;
+	for( size_t i = 0; i < TEST_BLOCKS; ++i ) {
+		blocks[i] = goal = ext2AllocBlock(ext2, TEST_INODE_A, goal);
+		if( goal == 0 ) {
+			fprintf(stderr, "single: ran out of blocks after %zu\n", i);
+			return false;
+		}
+	}
+
+	ext2CloseFile(ext2, TEST_INODE_A);
+
+	for( size_t i = 1; i < TEST_BLOCKS; ++i ) {
+		if( blocks[i] != blocks[i - 1] + 1 ) {
+			fprintf(
+				stderr, "single: block %zu is %" PRIu32 ", after %" PRIu32 "\n",
+				i, blocks[i], blocks[i - 1]
+			);
+			return false;
+		}
+	}
+
+	return ext2CheckCounts(ext2);
+}
+
+/* Two files extended in turns don't break each other's runs up */
+static bool _testInterleaved(Ext2 *ext2) {
+	uint32_t a[TEST_BLOCKS], b[TEST_BLOCKS];
+
+	uint32_t goalA = 0, goalB = 0;
+	for( size_t i = 0; i < TEST_BLOCKS; ++i ) {
+		a[i] = goalA = ext2AllocBlock(ext2, TEST_INODE_A, goalA);
+		b[i] = goalB = ext2AllocBlock(ext2, TEST_INODE_B, goalB);
+
+		if( goalA == 0 || goalB == 0 ) {
+			fprintf(stderr, "interleaved: ran out of blocks after %zu\n", i);
+			return false;
+		}
+	}
+
+	ext2CloseFile(ext2, TEST_INODE_A);
+	ext2CloseFile(ext2, TEST_INODE_B);
+
+	return _checkRuns("interleaved A", a, TEST_BLOCKS)
+		&& _checkRuns("interleaved B", b, TEST_BLOCKS) && ext2CheckCounts(ext2);
+}
+
+/* A file that has room for its first indirect block but not the data block
+ * after it keeps the indirect block, rather than leaving it taken but unused
+ */
+static bool _testIndirect(Ext2 *ext2) {
+	const Superblock *SB = &ext2->bgs->sb;
+
+	uint32_t inodenum;
+	uint8_t filetype;
+	if( !ext2Lookup(
+			ext2, INODE_RES_ROOT_DIR, TEST_FILE, &inodenum, &filetype
+		) ) {
+		fprintf(stderr, "indirect: '%s' not found\n", TEST_FILE);
+		return false;
+	}
+
+	uint32_t goal = 0;
+	while( SB->freeBlocksCount > SB->reservedBlocksCount + 1 ) {
+		if( (goal = ext2AllocBlock(ext2, TEST_INODE_C, goal)) == 0 ) {
+			fprintf(stderr, "indirect: ran out of blocks filling up\n");
+			return false;
+		}
+	}
+
+	ext2CloseFile(ext2, TEST_INODE_C);
+
+	Inode before, after;
+	ext2GetInode(ext2, inodenum, &before);
+
+	if( ext2ExtendFile(ext2, inodenum, 1) ) {
+		fprintf(stderr, "indirect: two blocks fit in one\n");
+		return false;
+	}
+
+	ext2GetInode(ext2, inodenum, &after);
+
+	const uint32_t SECTORS = (1024 << SB->logBlockSize) / 512;
+	if( after.block[INODE_DIRECT_BLOCKS] == 0
+		|| after.blocks != before.blocks + SECTORS ) {
+		fprintf(
+			stderr,
+			"indirect: the file doesn't have the block it took (%" PRIu32
+			" sectors, was %" PRIu32 ")\n",
+			after.blocks, before.blocks
+		);
+		return false;
+	}
+
+	return ext2CheckCounts(ext2);
+}
+
+/* Filling the image up stops short of the reserved blocks */
+static bool _testFull(Ext2 *ext2) {
+	const Superblock *SB = &ext2->bgs->sb;
+
+	uint32_t goal = 0;
+	while( (goal = ext2AllocBlock(ext2, TEST_INODE_C, goal)) != 0 ) {
+	}
+
+	ext2CloseFile(ext2, TEST_INODE_C);
+
+	if( SB->freeBlocksCount != SB->reservedBlocksCount ) {
+		fprintf(
+			stderr,
+			"full: %" PRIu32 " blocks left free, %" PRIu32 " are reserved\n",
+			SB->freeBlocksCount, SB->reservedBlocksCount
+		);
+		return false;
+	}
+
+	return ext2CheckCounts(ext2);
+}
+
+/* Checks that every run of consecutive blocks but the last is at least a
+ * window long
+ */
+static bool _checkRuns(const char *NAME, const uint32_t *blocks, size_t count) {
+	size_t start = 0;
+	for( size_t i = 1; i < count; ++i ) {
+		if( blocks[i] == blocks[i - 1] + 1 ) {
+			continue;
+		}
+
+		if( i - start < BALLOC_DEFAULT_WINDOW ) {
+			fprintf(
+				stderr, "%s: run at %" PRIu32 " is only %zu blocks long\n",
+				NAME, blocks[start], i - start
+			);
+			return false;
+		}
+
+		start = i;
+	}
+
+	return true;
+}
@@ -0,0 +1,162 @@
+/* ext2p
+ * Bitmap test
+ *
+ * Checks the word-at-a-time bitmap helpers against the same thing done a bit
+ * at a time, on bitmaps with long full and empty stretches as well as random
+ * bits, and at lengths that don't end on a byte or a word
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+
+/* Big enough for a group of 4K blocks */
+#define TEST_BITS 32768
+#define TEST_ROUNDS 200
+
+static void _fill(char *bits, unsigned round);
+static bool _testScans(const char *bits, size_t nbits);
+static bool _testRanges(char *bits, size_t nbits);
+static size_t _findZero(const char *bits, size_t nbits, size_t start);
+static size_t _findZeroRun(
+	const char *bits, size_t nbits, size_t start, size_t len
+);
+
+int main(void) {
+	static char bits[TEST_BITS / 8];
+
+	srand(1);
+	for( unsigned round = 0; round < TEST_ROUNDS; ++round ) {
+		_fill(bits, round);
+
+		/* Lengths off byte and word boundaries leave bits nothing may read */
+		const size_t NBITS = TEST_BITS - (size_t)(rand() % 130);
+		if( !_testScans(bits, NBITS) || !_testRanges(bits, NBITS) ) {
+			fprintf(stderr, "round %u, %zu bits\n", round, NBITS);
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Fills 'bits' with stretches of set, clear and random bytes */
+static void _fill(char *bits, unsigned round) {
+	size_t at = 0;
+	while( at < TEST_BITS / 8 ) {
+		size_t len = 1 + (size_t)(rand() % 512);
+		if( len > TEST_BITS / 8 - at ) {
+			len = TEST_BITS / 8 - at;
+		}
+
+		/* Every few rounds are random all through */
+		const int KIND = (round % 4 == 0) ? 2 : rand() % 3;
+		for( size_t i = 0; i < len; ++i ) {
+			if( KIND == 2 ) {
+				bits[at + i] = (char)(rand() & 0xFF);
+			} else {
+				bits[at + i] = (KIND == 0) ? 0 : (char)0xFF;
+			}
+		}
+
+		at += len;
+	}
+}
+
+static bool _testScans(const char *bits, size_t nbits) {
+	size_t count = 0;
+	for( size_t i = 0; i < nbits; ++i ) {
+		count += bitmapTest(bits, i);
+	}
+
+	if( bitmapCount(bits, nbits) != count ) {
+		fprintf(
+			stderr, "count is %zu, expected %zu\n", bitmapCount(bits, nbits),
+			count
+		);
+		return false;
+	}
+
+	for( int i = 0; i < 64; ++i ) {
+		const size_t START = (size_t)rand() % (nbits + 8);
+		const size_t LEN = 1 + (size_t)(rand() % 40);
+
+		const size_t ZERO = bitmapFindZero(bits, nbits, START);
+		if( ZERO != _findZero(bits, nbits, START) ) {
+			fprintf(stderr, "first zero from %zu is %zu\n", START, ZERO);
+			return false;
+		}
+
+		const size_t RUN = bitmapFindZeroRun(bits, nbits, START, LEN);
+		if( RUN != _findZeroRun(bits, nbits, START, LEN) ) {
+			fprintf(
+				stderr, "first run of %zu from %zu is %zu\n", LEN, START, RUN
+			);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Sets and clears random ranges, checking no bit outside them changes */
+static bool _testRanges(char *bits, size_t nbits) {
+	static char before[TEST_BITS / 8];
+
+	for( int i = 0; i < 16; ++i ) {
+		const size_t START = (size_t)rand() % nbits;
+		const size_t COUNT = (size_t)rand() % (nbits - START + 1);
+		const bool SET = rand() & 1;
+
+		memcpy(before, bits, sizeof(before));
+		if( SET ) {
+			bitmapSetRange(bits, START, COUNT);
+		} else {
+			bitmapClearRange(bits, START, COUNT);
+		}
+
+		for( size_t b = 0; b < TEST_BITS; ++b ) {
+			const bool IN = b >= START && b < START + COUNT;
+			const bool WANT = IN ? SET : bitmapTest(before, b);
+
+			if( bitmapTest(bits, b) != WANT ) {
+				fprintf(
+					stderr, "%s %zu bits from %zu: bit %zu is wrong\n",
+					SET ? "setting" : "clearing", COUNT, START, b
+				);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static size_t _findZero(const char *bits, size_t nbits, size_t start) {
+	for( size_t i = start; i < nbits; ++i ) {
+		if( !bitmapTest(bits, i) ) {
+			return i;
+		}
+	}
+
+	return BITMAP_NONE;
+}
+
+static size_t _findZeroRun(
+	const char *bits, size_t nbits, size_t start, size_t len
+) {
+	size_t run = 0;
+	for( size_t i = start; i < nbits; ++i ) {
+		run = bitmapTest(bits, i) ? 0 : run + 1;
+		if( run == len ) {
+			return i + 1 - len;
+		}
+	}
+
+	return BITMAP_NONE;
+}
@@ -0,0 +1,147 @@
+/* ext2p
+ * Directory listing test
+ *
+ * Lists a directory of 'count' files named f00000, f00001 and so on with
+ * ext2GetDir, and checks the list against the directory walked with
+ * ext2DirIterate: same entries in the same order, every file there once, and
+ * every name in the list's name pool
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dir.h"
+#include "ext2.h"
+#include "inode.h"
+
+/* What '_compareEntry' needs while the directory is walked again */
+typedef struct _TestWalk {
+	const DirList *LIST;
+	size_t at; /* Entry of 'LIST' the next one should match */
+	bool ok;
+} TestWalk;
+
+static bool _compareEntry(Dir *dir, void *ctx);
+static bool _checkList(const DirList *LIST, unsigned long count);
+
+int main(int argc, char **argv) {
+	if( argc != 4 ) {
+		fprintf(stderr, "usage: %s [image] [dir] [count]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const unsigned long COUNT = strtoul(argv[3], NULL, 10);
+
+	Ext2 *ext2 = ext2Open(argv[1]);
+	if( ext2 == NULL ) {
+		fprintf(stderr, "couldn't open '%s'\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	uint32_t inode;
+	uint8_t filetype;
+	if( !ext2Lookup(ext2, INODE_RES_ROOT_DIR, argv[2], &inode, &filetype) ) {
+		fprintf(stderr, "'%s' not found\n", argv[2]);
+		ext2Free(ext2);
+		return EXIT_FAILURE;
+	}
+
+	DirList list;
+	bool ok = ext2GetDir(ext2, inode, &list) && _checkList(&list, COUNT);
+
+	if( ok ) {
+		TestWalk walk = { .LIST = &list, .at = 0, .ok = true };
+		ext2DirIterate(ext2, inode, _compareEntry, &walk);
+
+		if( walk.ok && walk.at != list.count ) {
+			fprintf(
+				stderr, "walk saw %zu entries, list has %zu\n", walk.at,
+				list.count
+			);
+			walk.ok = false;
+		}
+
+		ok = walk.ok;
+	}
+
+	dirListFree(&list);
+	ext2Free(ext2);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Visitor matching each entry against the next one in the list */
+static bool _compareEntry(Dir *dir, void *ctx) {
+	TestWalk *walk = ctx;
+
+	if( walk->at == walk->LIST->count ) {
+		fprintf(stderr, "walk has more entries than the list\n");
+		walk->ok = false;
+		return false;
+	}
+
+	const Dir *ENTRY = &walk->LIST->entries[walk->at++];
+	if( ENTRY->inode != dir->inode
+		|| strcmp(ENTRY->filename, dir->filename) != 0 ) {
+		fprintf(
+			stderr, "entry %zu is '%s' in the list, '%s' in the walk\n",
+			walk->at - 1, ENTRY->filename, dir->filename
+		);
+		walk->ok = false;
+		return false;
+	}
+
+	return true;
+}
+
+/* Checks that the list holds '.', '..' and each of the 'count' files once */
+static bool _checkList(const DirList *LIST, unsigned long count) {
+	if( LIST->count != count + 2 ) {
+		fprintf(
+			stderr, "list has %zu entries, expected %lu\n", LIST->count,
+			count + 2
+		);
+		return false;
+	}
+
+	bool *seen = calloc(count, sizeof(*seen));
+	if( seen == NULL ) {
+		fprintf(stderr, "couldn't allocate memory\n");
+		return false;
+	}
+
+	bool ok = true;
+	for( size_t i = 0; ok && i < LIST->count; ++i ) {
+		const Dir *ENTRY = &LIST->entries[i];
+
+		/* Names are packed into the pool, not allocated one by one */
+		const char *NAME = ENTRY->filename;
+		if( NAME < LIST->names || NAME >= LIST->names + LIST->namesSize ) {
+			fprintf(stderr, "name of entry %zu is outside the pool\n", i);
+			ok = false;
+			break;
+		}
+
+		if( strcmp(NAME, ".") == 0 || strcmp(NAME, "..") == 0 ) {
+			continue;
+		}
+
+		char *end;
+		const unsigned long N = strtoul(NAME + 1, &end, 10);
+		if( NAME[0] != 'f' || *end != '\0' || N >= count || seen[N] ) {
+			fprintf(stderr, "unexpected or repeated entry '%s'\n", NAME);
+			ok = false;
+			break;
+		}
+
+		seen[N] = true;
+	}
+
+	free(seen);
+	return ok;
+}
@@ -0,0 +1,172 @@
+/* ext2p
+ * File read test
+ *
+ * Reads every file in the root of an image made from a directory with
+ * 'mke2fs -d', and compares it with the file it was made from: once front to
+ * back in chunks that don't line up with blocks, once backwards, and once past
+ * the end
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dir.h"
+#include "ext2.h"
+#include "file.h"
+#include "inode.h"
+
+/* Chunk sizes chosen not to divide any block size */
+#define TEST_CHUNK 1000
+#define TEST_BACK_CHUNK 333
+
+/* What '_testEntry' needs for each file */
+typedef struct _TestFiles {
+	Ext2 *ext2;
+	const char *DIR;
+	size_t count; /* Files checked so far */
+	bool ok;
+} TestFiles;
+
+static bool _testEntry(Dir *dir, void *ctx);
+static bool _testFile(
+	Ext2File *file, const char *NAME, const char *DATA, size_t size
+);
+static char *_slurp(const char *PATH, size_t *size);
+
+int main(int argc, char **argv) {
+	if( argc != 3 ) {
+		fprintf(stderr, "usage: %s [image] [dir]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Ext2 *ext2 = ext2Open(argv[1]);
+	if( ext2 == NULL ) {
+		fprintf(stderr, "couldn't open '%s'\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	TestFiles files = { .ext2 = ext2, .DIR = argv[2], .count = 0, .ok = true };
+	ext2DirIterate(ext2, INODE_RES_ROOT_DIR, _testEntry, &files);
+
+	ext2Free(ext2);
+
+	if( files.count == 0 ) {
+		fprintf(stderr, "no files in '%s'\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	return files.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Visitor checking each regular file against its original */
+static bool _testEntry(Dir *dir, void *ctx) {
+	TestFiles *files = ctx;
+	if( dir->filetype != DIR_FT_FILE ) {
+		return true;
+	}
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", files->DIR, dir->filename);
+
+	size_t size;
+	char *data = _slurp(path, &size);
+	if( data == NULL ) {
+		fprintf(stderr, "couldn't read '%s'\n", path);
+		files->ok = false;
+		return false;
+	}
+
+	Ext2File *file = ext2FileOpen(files->ext2, dir->inode);
+	if( file == NULL ) {
+		free(data);
+		files->ok = false;
+		return false;
+	}
+
+	files->ok = _testFile(file, dir->filename, data, size);
+	++files->count;
+
+	ext2FileClose(file);
+	free(data);
+
+	return files->ok;
+}
+
+static bool _testFile(
+	Ext2File *file, const char *NAME, const char *DATA, size_t size
+) {
+	char buf[TEST_CHUNK];
+
+	if( file->size != size ) {
+		fprintf(
+			stderr, "%s: size is %" PRIu64 ", expected %zu\n", NAME, file->size,
+			size
+		);
+		return false;
+	}
+
+	/* Front to back, as a reader streaming the file would */
+	for( size_t at = 0; at < size; at += TEST_CHUNK ) {
+		const size_t WANT = (size - at < TEST_CHUNK) ? size - at : TEST_CHUNK;
+		const size_t GOT = ext2FileRead(file, at, buf, TEST_CHUNK);
+
+		if( GOT != WANT || memcmp(buf, DATA + at, WANT) != 0 ) {
+			fprintf(stderr, "%s: sequential read at %zu differs\n", NAME, at);
+			return false;
+		}
+	}
+
+	/* Back to front, which keeps resetting the readahead window */
+	for( size_t end = size; end > 0; ) {
+		const size_t LEN = (end < TEST_BACK_CHUNK) ? end : TEST_BACK_CHUNK;
+		end -= LEN;
+
+		const size_t GOT = ext2FileRead(file, end, buf, LEN);
+		if( GOT != LEN || memcmp(buf, DATA + end, LEN) != 0 ) {
+			fprintf(stderr, "%s: backward read at %zu differs\n", NAME, end);
+			return false;
+		}
+	}
+
+	if( ext2FileRead(file, size, buf, TEST_CHUNK) != 0 ) {
+		fprintf(stderr, "%s: read past the end returned data\n", NAME);
+		return false;
+	}
+
+	return true;
+}
+
+/* Reads the whole file at 'PATH' into memory */
+static char *_slurp(const char *PATH, size_t *size) {
+	FILE *fp = fopen(PATH, "rb");
+	if( fp == NULL ) {
+		return NULL;
+	}
+
+	size_t capacity = 64 * 1024;
+	char *data = malloc(capacity);
+	*size = 0;
+
+	size_t got;
+	while( data != NULL
+		&& (got = fread(data + *size, 1, capacity - *size, fp)) > 0 ) {
+		*size += got;
+		if( *size == capacity ) {
+			capacity *= 2;
+			char *grown = realloc(data, capacity);
+			if( grown == NULL ) {
+				free(data);
+			}
+
+			data = grown;
+		}
+	}
+
+	fclose(fp);
+	return data;
+}